@@ -0,0 +1,170 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef LINEAROCTREE_H
+#define LINEAROCTREE_H
+
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <vector>
+
+#include "Octree.hpp"
+
+/*! \brief Read-only octree stored as a flat array of nodes.
+ *
+ * Where \ref Octree is a tree of heap allocated nodes, a LinearOctree holds
+ * the structure of an octree file in a single array, in breadth-first order :
+ * the root comes first, the children of a node are contiguous, and a level
+ * is fully stored before the next one. Nodes refer to their children by index,
+ * so traversing the tree (for culling or spatial queries) reads memory
+ * sequentially instead of chasing pointers.
+ *
+ * It is constructed directly from the structure at the beginning of an octree
+ * file. Chunks are only read on demand with \ref readChunk.
+ */
+class LinearOctree
+{
+  public:
+	/*! \brief Index of a node within \ref getNodes.
+	 */
+	typedef uint32_t Index;
+
+	/*! \brief Node of the tree.
+	 */
+	struct Node
+	{
+		/*! \brief Address of the node's chunk within the file.
+		 */
+		int64_t file_addr;
+		/*! \brief Size in bytes of the node's chunk within the file, or 0 if
+		 * the file has no node table.
+		 */
+		uint64_t chunkSize;
+		/*! \brief Same as \ref Octree::getTotalDataSize.
+		 */
+		uint64_t totalDataSize;
+		/*! \brief Bounding box of the node's vertices.
+		 */
+		float minX, maxX, minY, maxY, minZ, maxZ;
+		/*! \brief Index of the first existing child (meaningless for a leaf).
+		 *
+		 * The other existing children follow it, in increasing child number.
+		 */
+		Index firstChild;
+		/*! \brief Bit i is set if child i exists, as in \ref Octree
+		 * children.
+		 */
+		uint8_t childMask;
+
+		/*! \brief Returns true if the node has no children.
+		 */
+		bool isLeaf() const { return childMask == 0; };
+		/*! \brief Returns the number of children of the node.
+		 */
+		unsigned int childrenNumber() const
+		{
+			return std::bitset<8>(childMask).count();
+		};
+	};
+
+	/*! \brief Index of the root node.
+	 */
+	static const Index root = 0;
+	/*! \brief Returned by \ref getChild for a child that doesn't exist.
+	 */
+	static const Index noNode = UINT32_MAX;
+
+	/*! \brief Reads the tree structure of an octree file.
+	 *
+	 * The stream must be at the beginning of the file (where \ref write
+	 * started writing). Doesn't read any chunk. If the file has a node table
+	 * (see \ref Octree::Flags::NODE_TABLE), the nodes are read from it in a
+	 * single block instead of parsing the structure.
+	 *
+	 * Throws a std::string if the file can't be read.
+	 */
+	void init(std::istream& in);
+
+	/*! \brief Returns the \ref Octree::Flags of the file.
+	 */
+	Octree::Flags getFlags() const { return flags; };
+	/*! \brief Returns number of components (dimensions) per vertex.
+	 */
+	unsigned int getDimPerVertex() const { return dimPerVertex; };
+	/*! \brief Returns the major version of the file format.
+	 */
+	uint32_t getVersionMajor() const { return versionMajor; };
+	/*! \brief Returns the minor version of the file format.
+	 */
+	uint32_t getVersionMinor() const { return versionMinor; };
+
+	/*! \brief Returns the alignment in bytes of the chunks data within the
+	 * file (1 if chunks are packed).
+	 *
+	 * The data of a node starts right after its chunk header : at its
+	 * file_addr + 8 (its size), or at its file_addr +
+	 * \ref codec::chunkHeaderSize if \ref Octree::hasChunkCodec is true for
+	 * the flags of the file. See \ref Octree::setChunkAlignment.
+	 */
+	uint64_t getChunkAlignment() const { return chunkAlignment; };
+
+	/*! \brief Returns all the nodes, in breadth-first order (the root
+	 * first).
+	 */
+	std::vector<Node> const& getNodes() const { return nodes; };
+	/*! \brief Returns the node at index \p i.
+	 */
+	Node const& operator[](Index i) const { return nodes[i]; };
+	/*! \brief Returns the number of nodes of the tree (0 if not initialized).
+	 */
+	size_t size() const { return nodes.size(); };
+
+	/*! \brief Returns the index of child \p i (from 0 to 7) of \p node, or
+	 * \ref noNode if this child doesn't exist.
+	 */
+	Index getChild(Index node, unsigned int i) const;
+
+	/*! \brief Visits the nodes of the tree in depth-first order.
+	 *
+	 * \param visitor : called with each visited node, returns true if the
+	 * children of the node should be visited as well (for culling for
+	 * example).
+	 */
+	void traverse(std::function<bool(Index)> const& visitor) const;
+
+	/*! \brief Reads the chunk of \p node from the file \p in, which the tree
+	 * was initialized from.
+	 *
+	 * It holds the same data as \ref Octree::getOwnData after \ref
+	 * Octree::readData.
+	 */
+	std::vector<float> readChunk(std::istream& in, Index node) const;
+
+  private:
+	Octree::Flags flags       = Octree::Flags::NONE;
+	unsigned int dimPerVertex = 3;
+	uint32_t versionMajor     = VERSION_MAJOR;
+	uint32_t versionMinor     = VERSION_MINOR;
+	uint64_t chunkAlignment   = 1;
+
+	std::vector<Node> nodes;
+};
+
+#endif // LINEAROCTREE_H
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*! \brief Bump allocator for the nodes of a tree.
+ *
+ * Memory is taken from big blocks and is only given back all at once, when the
+ * arena is destroyed. Each thread allocates from its own current block, so that
+ * concurrent allocations don't contend and nodes created one after another by
+ * the same thread (like the first levels of a tree, or siblings) are contiguous
+ * in memory.
+ *
+ * It is used by \ref Octree to allocate the nodes of a tree, see
+ * Octree::operator new.
+ */
+class NodeArena
+{
+  public:
+	/*! \brief Alignment of the returned addresses.
+	 */
+	static const size_t alignment = alignof(std::max_align_t);
+
+	NodeArena();
+
+	NodeArena(NodeArena const& other)            = delete;
+	NodeArena& operator=(NodeArena const& other) = delete;
+
+	/*! \brief Returns \p size bytes aligned on \ref alignment.
+	 *
+	 * Can be called concurrently from several threads.
+	 */
+	void* allocate(size_t size);
+
+	/*! \brief Frees all the memory allocated by the arena.
+	 *
+	 * \attention The objects allocated within the arena must have been
+	 * destroyed before.
+	 */
+	~NodeArena();
+
+  private:
+	static const size_t blockSize = 65536;
+
+	// unique among all the arenas ever constructed, so that a thread never
+	// uses the current block of a destroyed arena
+	const uint64_t id;
+
+	std::mutex blocksMutex;
+	std::vector<char*> blocks;
+
+	char* newBlock(size_t size);
+};
+
+#endif // NODEARENA_H
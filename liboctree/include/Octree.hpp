@@ -24,9 +24,11 @@
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <mutex>
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include "binaryrw.hpp"
@@ -34,7 +36,12 @@
 #define MAX_THREADS 8
 
 #define VERSION_MAJOR 2
-#define VERSION_MINOR 0
+#define VERSION_MINOR 4
+
+class NodeArena;
+class ThreadPool;
+class OutOfCoreBucket;
+class ProgressCounter;
 
 /*! \mainpage
  *
@@ -54,31 +61,47 @@
  * extensively used by the \ref Octree class to read/write octrees.
  */
 
+/*! \brief Vertex data of an \ref Octree node.
+ *
+ * Either owns a vector, or references a range of floats owned by someone else
+ * (a vector, a memory-mapped file, a buffer of another library...).
+ */
 class Data
 {
   public:
 	Data() = default;
 	void setAsVector()
 	{
-		if(ref != nullptr && ownsVector)
+		if(vec != nullptr && ownsVector)
 		{
 			return;
 		}
 		ownsVector = true;
-		ref        = new std::vector<float>;
-		beg        = 0;
-		end        = 0;
+		vec        = new std::vector<float>;
+		ref        = nullptr;
+		refSize    = 0;
 	}
+	/*! \brief References elements \p beg to \p end (included) of \p ref.
+	 *
+	 * \attention The vector mustn't be resized as long as it is referenced.
+	 */
 	void setAsReference(std::vector<float>* ref, size_t beg, size_t end)
 	{
-		if(this->ref != nullptr && ownsVector)
+		setAsReference(ref->data() + beg, end + 1 - beg);
+	}
+	/*! \brief References \p size floats starting at \p ref, which won't be
+	 * freed by this Data.
+	 */
+	void setAsReference(float* ref, size_t size)
+	{
+		if(vec != nullptr && ownsVector)
 		{
-			delete this->ref;
+			delete vec;
 		}
 		ownsVector = false;
+		vec        = nullptr;
 		this->ref  = ref;
-		this->beg  = beg;
-		this->end  = end;
+		refSize    = size;
 	}
 
 	std::vector<float>& asVector() const
@@ -87,7 +110,7 @@ class Data
 		{
 			throw("Trying to access vector of non-owned vector.");
 		}
-		return *ref;
+		return *vec;
 	}
 
 	bool isReference() const { return !ownsVector; };
@@ -96,33 +119,33 @@ class Data
 	{
 		if(ownsVector)
 		{
-			return ref->size();
+			return vec->size();
 		}
-		return end - beg + 1;
+		return refSize;
 	}
 
 	float operator[](size_t i) const
 	{
 		if(ownsVector)
 		{
-			return (*ref)[i];
+			return (*vec)[i];
 		}
-		return (*ref)[beg + i];
+		return ref[i];
 	}
 	float& operator[](size_t i)
 	{
 		if(ownsVector)
 		{
-			return (*ref)[i];
+			return (*vec)[i];
 		}
-		return (*ref)[beg + i];
+		return ref[i];
 	}
 
 	void push_back(float val)
 	{
 		if(ownsVector)
 		{
-			ref->push_back(val);
+			vec->push_back(val);
 		}
 		else
 		{
@@ -134,16 +157,18 @@ class Data
 	{
 		if(ownsVector)
 		{
-			delete ref;
+			delete vec;
 		}
 	}
 
   private:
 	bool ownsVector = false;
 
-	std::vector<float>* ref = nullptr;
-	size_t beg              = 0;
-	size_t end              = 0;
+	// owned vector
+	std::vector<float>* vec = nullptr;
+	// referenced floats
+	float* ref     = nullptr;
+	size_t refSize = 0;
 };
 
 /*! \brief Octree main class
@@ -175,6 +200,34 @@ class Octree
 		 * outside Octree's code has no effect.
 		 */
 		VERSIONED = 0x0000000000000002ULL,
+		/*! \brief Set if the chunks are stored compressed.
+		 *
+		 * Each chunk then stores the codec used and its encoded size after its
+		 * number of floats (see codec.hpp). Files having compressed chunks are
+		 * written with format version 2.2.
+		 */
+		COMPRESSED_CHUNKS = 0x0000000000000004ULL,
+		/*! \brief Set if the positions of normalized nodes are stored as
+		 * 16-bit fixed-point numbers.
+		 *
+		 * This is lossy : positions are rounded to 1/65535 of the biggest
+		 * side of their node's bounding box, which is how they are expanded
+		 * back. It has no effect without NORMALIZED_NODES, and takes
+		 * precedence over COMPRESSED_CHUNKS (the other components are
+		 * stored as is). Chunks are laid out as compressed ones. Files having
+		 * quantized positions are written with format version 2.3.
+		 */
+		QUANTIZED_POSITIONS = 0x0000000000000008ULL,
+		/*! \brief Set if the file ends with a table of its nodes.
+		 *
+		 * The table stores for each node its chunk address and size, its
+		 * bounding box and where its children are, with a fixed size per
+		 * node, in the breadth-first order of \ref LinearOctree. Its address
+		 * is stored in the file header, so that readers can locate any node
+		 * without parsing the tree structure. Files having a node table are
+		 * written with format version 2.4.
+		 */
+		NODE_TABLE = 0x0000000000000010ULL,
 
 		// DATA TYPES STORED
 		/*! \brief Set if the particles radii are also stored.
@@ -194,6 +247,78 @@ class Octree
 		STORE_TEMPERATURE = 0x0000001000000000ULL,
 	};
 
+	/*! \brief How the LOD sample of non-leaf nodes is drawn during
+	 * construction.
+	 */
+	enum class SamplingMode
+	{
+		/*! \brief Each vertex is kept with probability maxLeafSize / (number
+		 * of vertices of the node), until maxLeafSize vertices are kept.
+		 *
+		 * The number of vertices of a node varies, usually below maxLeafSize.
+		 */
+		BERNOULLI,
+		/*! \brief Exactly maxLeafSize vertices are kept, uniformly chosen
+		 * (without replacement) among the vertices of the node.
+		 */
+		EXACT,
+	};
+
+	/*! \brief How nodes are split into their children during construction.
+	 *
+	 * Whatever the strategy, each child holds the vertices of one of the
+	 * octants defined by three split planes (one per axis) and has its own
+	 * bounding box. A node whose vertices can't be split (identical
+	 * positions) is a leaf, even if it holds more than maxLeafSize vertices.
+	 */
+	enum class SplitStrategy
+	{
+		/*! \brief The split planes go through the middle of the node's
+		 * bounding box.
+		 */
+		MIDPOINT,
+		/*! \brief The split planes go through the median position of the
+		 * node's vertices along each axis (estimated from a sample of them).
+		 *
+		 * Children hold about the same number of vertices, so that on
+		 * clustered data the tree stays about log8(N / maxLeafSize) levels
+		 * deep and leaves are fuller than with MIDPOINT. Not used by \ref
+		 * initMorton, nor by \ref initOutOfCore for the nodes it splits by
+		 * streaming.
+		 */
+		MEDIAN,
+	};
+
+	/*! \brief In which order the chunks of the nodes are laid out within the
+	 * files written.
+	 *
+	 * The file format is the same whatever the order, as nodes refer to their
+	 * chunk by address.
+	 */
+	enum class ChunkOrder
+	{
+		/*! \brief A node's chunk is followed by the chunks of its subtrees,
+		 * one after the other.
+		 *
+		 * The chunks of a subtree are contiguous, but nodes of the same level
+		 * can be far apart.
+		 */
+		DEPTH_FIRST,
+		/*! \brief Level by level from the root, the children of a node being
+		 * contiguous (the order of \ref LinearOctree).
+		 *
+		 * The first levels of the tree are contiguous at the beginning of the
+		 * chunks, so that a coarse LOD of the whole tree is loaded with a
+		 * single sequential read.
+		 */
+		BREADTH_FIRST,
+	};
+
+	/*! \brief Function called to report the progress of a construction,
+	 * from 0.0 (0%) to 1.0 (100%).
+	 */
+	typedef std::function<void(float progress)> ProgressCallback;
+
 	struct CommonData
 	{
 		uint32_t versionMajor = VERSION_MAJOR;
@@ -204,6 +329,41 @@ class Octree
 		 * positions).
 		 */
 		unsigned int dimPerVertex = 3;
+		/*! @brief Number of threads used to construct the tree (0 to use as
+		 * many threads as the hardware supports).
+		 */
+		unsigned int threadsNumber = 0;
+		/*! @brief Seed of the LOD sampling done during construction.
+		 */
+		uint64_t seed = 0;
+		/*! @brief How the LOD sample of non-leaf nodes is drawn during
+		 * construction.
+		 */
+		SamplingMode samplingMode = SamplingMode::BERNOULLI;
+		/*! @brief How nodes are split during construction.
+		 */
+		SplitStrategy splitStrategy = SplitStrategy::MIDPOINT;
+		/*! @brief In which order chunks are written.
+		 */
+		ChunkOrder chunkOrder = ChunkOrder::DEPTH_FIRST;
+		/*! @brief Alignment in bytes of the chunks data within a file (1 if
+		 * chunks are packed).
+		 */
+		uint64_t chunkAlignment = 1;
+		/*! @brief Arena in which the nodes of the tree are allocated (owned by
+		 * the root).
+		 */
+		NodeArena* arena = nullptr;
+		/*! @brief Called to report the progress of a construction (nothing is
+		 * reported if empty).
+		 */
+		ProgressCallback progressCallback;
+		/*! @brief Minimum time between two progress reports, in seconds.
+		 */
+		float progressInterval = 0.1f;
+		/*! @brief Progress of the running construction, if any.
+		 */
+		ProgressCounter* progress = nullptr;
 	};
 
 	/*! \brief Constructs an empty root node
@@ -228,6 +388,143 @@ class Octree
 	 */
 	unsigned int getDimPerVertex() const { return commonData.dimPerVertex; };
 
+	/*! \brief Returns number of components (dimensions) per vertex stored in
+	 * a tree having \p flags.
+	 */
+	static unsigned int getDimPerVertex(Flags flags);
+
+	/*! \brief Returns true if the chunks of a tree having \p flags store the
+	 * codec their data is encoded with (see codec.hpp), which is the case
+	 * with \ref Flags::COMPRESSED_CHUNKS or \ref Flags::QUANTIZED_POSITIONS.
+	 */
+	static bool hasChunkCodec(Flags flags);
+
+	/*! \brief Returns the biggest maxLeafSize for which the chunks of this
+	 * tree don't exceed \p chunkSize bytes, given its \ref Flags.
+	 *
+	 * A chunk holds its vertices and their number (8 bytes), plus 16 bytes
+	 * if \ref hasChunkCodec (encoded chunks are never bigger than raw ones
+	 * with their header). As non-leaf nodes hold at most maxLeafSize vertices
+	 * too, the chunks written by \ref write fit within \p chunkSize bytes
+	 * whatever the components stored, except the ones of leaves whose
+	 * vertices can't be split (more than maxLeafSize vertices at identical
+	 * positions, see \ref SplitStrategy). Set the flags first. Returns 0 if
+	 * \p chunkSize can't even hold one vertex.
+	 */
+	unsigned int getMaxLeafSizeForChunkSize(size_t chunkSize) const;
+
+	/*! \brief Returns the number of threads used by \ref init to construct
+	 * the tree (0 means as many as the hardware supports).
+	 */
+	unsigned int getThreadsNumber() const { return commonData.threadsNumber; };
+
+	/*! \brief Sets the number of threads used by \ref init to construct the
+	 * tree.
+	 *
+	 * The construction runs on a fixed-size pool of \p threadsNumber threads
+	 * to which the subtrees are submitted as tasks. If 0 (default), the pool
+	 * has as many threads as the hardware supports.
+	 */
+	void setThreadsNumber(unsigned int threadsNumber)
+	{
+		commonData.threadsNumber = threadsNumber;
+	};
+
+	/*! \brief Sets the function to call to report the progress of the
+	 * constructions (\ref init, \ref initMorton and \ref initOutOfCore).
+	 *
+	 * By default, nothing is reported. The callback can be called from any of
+	 * the construction threads, but never concurrently, and at most once every
+	 * \p interval seconds, except for the final 1.0 which is always reported
+	 * once the construction is done. Pass \ref showProgress to draw a progress
+	 * bar in the terminal.
+	 */
+	void setProgressCallback(ProgressCallback const& callback,
+	                         float interval = 0.1f)
+	{
+		commonData.progressCallback = callback;
+		commonData.progressInterval = interval;
+	};
+
+	/*! \brief Returns the seed of the LOD sampling done by \ref init.
+	 */
+	uint64_t getSeed() const { return commonData.seed; };
+
+	/*! \brief Sets the seed of the LOD sampling done by \ref init.
+	 *
+	 * Each node draws its sample from its own counter-based random generator,
+	 * keyed by \p seed and by the node's path from the root. Constructing a
+	 * tree from the same data with the same seed thus always gives the same
+	 * tree, whatever the number of threads.
+	 */
+	void setSeed(uint64_t seed) { commonData.seed = seed; };
+
+	/*! \brief Returns how \ref init draws the LOD sample of non-leaf nodes.
+	 */
+	SamplingMode getSamplingMode() const { return commonData.samplingMode; };
+
+	/*! \brief Sets how \ref init draws the LOD sample of non-leaf nodes.
+	 *
+	 * See \ref SamplingMode. With SamplingMode::EXACT, all non-leaf nodes hold
+	 * exactly maxLeafSize vertices.
+	 */
+	void setSamplingMode(SamplingMode samplingMode)
+	{
+		commonData.samplingMode = samplingMode;
+	};
+
+	/*! \brief Returns how \ref init splits nodes.
+	 */
+	SplitStrategy getSplitStrategy() const
+	{
+		return commonData.splitStrategy;
+	};
+
+	/*! \brief Sets how \ref init splits nodes.
+	 *
+	 * See \ref SplitStrategy.
+	 */
+	void setSplitStrategy(SplitStrategy splitStrategy)
+	{
+		commonData.splitStrategy = splitStrategy;
+	};
+
+	/*! \brief Returns in which order \ref writeData lays out the chunks.
+	 */
+	ChunkOrder getChunkOrder() const { return commonData.chunkOrder; };
+
+	/*! \brief Sets in which order \ref writeData lays out the chunks.
+	 *
+	 * See \ref ChunkOrder. Not used by \ref initOutOfCore, which writes the
+	 * chunks as their nodes are constructed, nor by \ref append, which writes
+	 * the chunks it touches at the end of the file.
+	 */
+	void setChunkOrder(ChunkOrder chunkOrder)
+	{
+		commonData.chunkOrder = chunkOrder;
+	};
+
+	/*! \brief Returns the alignment in bytes of the chunks data within a file.
+	 */
+	uint64_t getChunkAlignment() const { return commonData.chunkAlignment; };
+
+	/*! \brief Sets the alignment in bytes of the chunks data within the files
+	 * written afterwards.
+	 *
+	 * Each chunk is preceded by zeros so that its data (right after its size,
+	 * or after its \ref codec::chunkHeaderSize bytes header if
+	 * \ref hasChunkCodec) starts at a multiple of \p chunkAlignment within
+	 * the file, for example 4096 to read them with direct I/O or to map them
+	 * in memory. Files having aligned chunks are written with format version
+	 * 2.1, which stores the alignment in the header (or 2.2 if they are
+	 * compressed). Packed chunks (alignment of 1, the default) are written
+	 * with format version 2.0. Reading a file sets the alignment to the one
+	 * of the file.
+	 *
+	 * Throws a std::string if \p chunkAlignment isn't a power of two.
+	 */
+	void setChunkAlignment(uint64_t chunkAlignment);
+
 	/*! \brief Returns the bounding box's minimum x coordinate */
 	float getMinX() const { return minX; };
 	/*! \brief Returns the bounding box's maximum x coordinate */
@@ -254,10 +551,93 @@ class Octree
 	 */
 	virtual void init(std::vector<float>& data, unsigned int maxLeafSize = 16000);
 
+	/*! \brief Initializes the octree from position data held by a raw buffer.
+	 *
+	 * Same as \ref init(std::vector<float>&, unsigned int), for data which
+	 * isn't held by a vector (memory-mapped file, buffer of another
+	 * library...), so that it doesn't need to be copied. The octree is
+	 * constructed in place : vertices are reordered within \p data and leaves
+	 * reference them.
+	 *
+	 * \warning The octree will keep \p data as reference. It must stay valid
+	 * and writable as long as the octree is alive (a read-only file can be
+	 * mapped privately, with copy-on-write).
+	 *
+	 * \param data : buffer holding positions, structured as for \ref
+	 * init(std::vector<float>&, unsigned int)
+	 * \param size : number of floats within \p data
+	 */
+	virtual void init(float* data, size_t size,
+	                  unsigned int maxLeafSize = 16000);
+
+	/*! \brief Initializes the octree from position data, sorting it along a
+	 * Morton (Z-order) curve first.
+	 *
+	 * Alternative construction engine to \ref init(std::vector<float>&,
+	 * unsigned int) which scales better with the number of threads, at the
+	 * cost of more memory (about 32 bytes per vertex on top of \p data during
+	 * construction). Nodes are split on a regular grid spanning the whole data
+	 * bounding box instead of at the middle of their own bounding box, but the
+	 * resulting octree is used (and written) exactly the same way.
+	 *
+	 * \warning For memory efficiency reasons, the octree will keep \p data
+	 * vector as reference. You should keep it alive as long as the octree is
+	 * alive. Its vertices will be reordered.
+	 *
+	 * \param data : vector holding positions, structured as follows for N
+	 * points : {x1, y1, z1, ... xN, yN, zN}.
+	 */
+	virtual void initMorton(std::vector<float>& data,
+	                        unsigned int maxLeafSize = 16000);
+
+	/*! \brief Function receiving a batch of vertices, structured like the
+	 * data of \ref init(std::vector<float>&, unsigned int).
+	 */
+	typedef std::function<void(std::vector<float> const& vertices)>
+	    VerticesConsumer;
+
+	/*! \brief Initializes the octree from position data that doesn't fit in
+	 * memory and writes it to a stream.
+	 *
+	 * The vertices are first spilled to a temporary file. Then, each node
+	 * whose vertices don't fit within \p memoryBudget is split by streaming
+	 * its file into one file per child, until the vertices of a subtree fit
+	 * within \p memoryBudget. That subtree is then constructed in memory like
+	 * \ref init(std::vector<float>&, unsigned int) would. Chunks are written
+	 * as soon as they are computed, so that only the tree structure is kept in
+	 * memory.
+	 *
+	 * The resulting octree has the same nodes, bounding boxes and leaves
+	 * vertices as the one \ref init(std::vector<float>&, unsigned int) would
+	 * construct from the same vertices (with SamplingMode::EXACT, the
+	 * structure written is identical), but vertices may be ordered
+	 * differently within the chunks and the LOD samples may differ.
+	 *
+	 * Afterwards, this octree holds the tree structure without data, as after
+	 * \ref init(std::istream&).
+	 *
+	 * \param out : stream to which the octree is written, as \ref write would
+	 * \param produceVertices : called once, must give all the vertices to the
+	 * \ref VerticesConsumer it receives, in as many batches as needed
+	 * \param maxLeafSize : same as for \ref init(std::vector<float>&, unsigned
+	 * int)
+	 * \param memoryBudget : approximate maximum memory used for vertices, in
+	 * bytes (batches given by \p produceVertices aside)
+	 * \param tmpDir : directory where temporary files are written. It needs
+	 * about twice the size of the vertices.
+	 */
+	virtual void
+	    initOutOfCore(std::ostream& out,
+	                  std::function<void(VerticesConsumer const&)> const&
+	                      produceVertices,
+	                  unsigned int maxLeafSize, size_t memoryBudget,
+	                  std::string const& tmpDir = ".");
+
 	/*! \brief Initializes the octree from a stream.
 	 *
 	 * The tree will only read its structure and not its data. To read the data,
-	 * call \ref readData afterwards.
+	 * call \ref readData afterwards. The structure is read in memory in one
+	 * call when the stream starts with a file header and parsed from there.
 	 *
 	 * \param in : stream from which to read the structure
 	 */
@@ -265,8 +645,8 @@ class Octree
 
 	/*! \brief Initializes the octree from a address within a file.
 	 *
-	 * Typically called by init(std::istream&) when reading the structure if
-	 * this octree to be created is a leaf.
+	 * Reads the metadata of a leaf that follows its file address in a
+	 * structure (init(std::istream&) parses them without calling it).
 	 * No children will be created, only the file address will be set.
 	 *
 	 * \param file_addr : Address within the file where the data lies.
@@ -274,6 +654,51 @@ class Octree
 	 */
 	virtual void init(int64_t file_addr, std::istream& in);
 
+	/*! \brief Inserts vertices into an existing octree file.
+	 *
+	 * This octree must have been initialized from \p file with \ref
+	 * init(std::istream&) (without reading its data). Each vertex is routed
+	 * down the existing structure, to the child whose bounding box contains
+	 * it (or else the nearest child), bounding boxes are extended and the
+	 * LOD samples of the nodes along the way are updated. A leaf is
+	 * constructed again from its vertices and the new ones (and split if they
+	 * don't fit within \p maxLeafSize anymore).
+	 *
+	 * Vertices outside of all the children of a node extend the bounding box
+	 * of one of them, so the boxes of siblings can overlap afterwards : the
+	 * tree doesn't partition space exactly anymore, and no child is created
+	 * in the octants that were empty. With SamplingMode::EXACT, the LOD
+	 * samples stay uniform samples of their subtree's vertices. With
+	 * SamplingMode::BERNOULLI, samples hold less than maxLeafSize vertices
+	 * and are filled with new vertices first, which are then over-represented.
+	 *
+	 * Only the chunks of the touched nodes are rewritten, at the end of the
+	 * file, and the tree structure is rewritten in place (a few chunks are
+	 * moved to the end of the file if it grew too much). The cost is then
+	 * proportional to the number of new vertices and not to the size of the
+	 * tree. The previous chunks of the touched nodes are left unused within
+	 * the file : it grows a bit more than the data added.
+	 *
+	 * The vertices must have the same components as the tree's ones. They are
+	 * reordered (and normalized if the nodes are) within \p vertices.
+	 *
+	 * Throws a std::string if the file can't be appended to.
+	 *
+	 * \param file : octree file, opened for reading and writing
+	 * \param vertices : vertices to insert, structured as for \ref
+	 * init(std::vector<float>&, unsigned int)
+	 * \param maxLeafSize : same as for \ref init(std::vector<float>&,
+	 * unsigned int), should be the one the tree was constructed with
+	 */
+	virtual void append(std::iostream& file, std::vector<float>& vertices,
+	                    unsigned int maxLeafSize = 16000);
+
+	/*! \brief Same as \ref append(std::iostream&, std::vector<float>&,
+	 * unsigned int) with vertices held by a raw buffer of \p size floats.
+	 */
+	virtual void append(std::iostream& file, float* vertices, size_t size,
+	                    unsigned int maxLeafSize = 16000);
+
 	/*! \brief Size of the total non-redundant data stored in the tree.
 	 *
 	 * It is effectively the sum of the data sizes of all the leaves.
@@ -296,17 +721,76 @@ class Octree
 	 * to represent a TREE from the grammar. If this is the root node, don't
 	 * forget not to write the size of the vector and the first parenthesis to
 	 * fully comply to the format.
+	 *
+	 * It isn't virtual : \ref write and \ref writeStructure walk the tree
+	 * themselves and don't call it.
+	 */
+	std::vector<int64_t> getCompactData() const;
+
+	/*! \brief Returns the number of 64bit ints \ref writeStructure writes for
+	 * this tree.
+	 *
+	 * The tree is walked once without building its compact data.
+	 */
+	size_t getStructureSize() const;
+
+	/*! \brief Writes the TREE from the grammar in \p out, as found in a file
+	 * right after its header.
+	 *
+	 * Same as writing \ref getCompactData without its first parenthesis (or
+	 * followed by a closing one if this node is a leaf), but the tokens are
+	 * buffered and written while walking the tree, which doesn't need more
+	 * memory than its depth.
+	 */
+	void writeStructure(std::ostream& out) const;
+
+	/*! \brief Writes the node table of this tree in \p out (see \ref
+	 * Flags::NODE_TABLE).
+	 *
+	 * The chunks must have been written first, as their addresses and sizes
+	 * are part of the table.
+	 *
+	 * Throws a std::string if the tree has too many nodes to be indexed with
+	 * 32 bits.
 	 */
-	virtual std::vector<int64_t> getCompactData() const;
+	void writeNodeTable(std::ostream& out) const;
+
+	/*! \brief Size in bytes of a node within a node table : chunk address
+	 * (64 bits), chunk size in bytes (64 bits), total data size (64 bits),
+	 * bounding box (6 floats), index of the first child and child mask (32
+	 * bits each).
+	 */
+	static const size_t nodeTableEntrySize = 56;
 
 	/*! \brief Writes the data within the stream and updates file_addr
 	 * accordingly.
 	 *
-	 * It will write all min/maxes and the position data.
+	 * It will write all min/maxes and the position data, in the order set by
+	 * \ref setChunkOrder.
 	 * \param out : stream to which to write
 	 */
 	virtual void writeData(std::ostream& out);
 
+	/*! \brief Writes the data within the file at \p path, starting at
+	 * \p dataStart, and updates file_addr accordingly.
+	 *
+	 * Same layout as \ref writeData, but the chunks addresses are computed
+	 * first, then the chunks are written concurrently by batches of
+	 * consecutive ones with positional writes (using as many threads as set by
+	 * \ref setThreadsNumber). The file is created if it doesn't exist, and the
+	 * bytes before \p dataStart are left untouched. Throws a std::string if
+	 * the file can't be written.
+	 */
+	virtual void writeData(std::string const& path, int64_t dataStart);
+
+	/*! \brief Writes this node's data within the stream and updates file_addr
+	 * accordingly.
+	 *
+	 * Same as \ref writeData, but children's data isn't written.
+	 * \param out : stream to which to write
+	 */
+	virtual void writeOwnData(std::ostream& out);
+
 	/*! \brief Reads data at file_addr from a stream
 	 *
 	 * It will read all min/maxes and the position data and ask its children (if
@@ -360,13 +844,37 @@ class Octree
 	 */
 	virtual std::string toString(std::string const& tabs = "") const;
 
+	Octree(Octree const& other)            = delete;
+	Octree& operator=(Octree const& other) = delete;
+
 	/*! \brief Destructor.
 	 *
-	 * Deletes children if any.
+	 * Deletes children if any. The root also frees the memory of all the nodes
+	 * of the tree at once (see operator new).
 	 */
 	virtual ~Octree();
 
+	/*! \brief Allocates a node.
+	 *
+	 * Nodes created as children of a tree (through \ref newChild) are allocated
+	 * within an arena owned by the root, which keeps the nodes close to each
+	 * other in memory and avoids one heap allocation per node. Other nodes are
+	 * allocated on the heap as usual.
+	 *
+	 * Classes inheriting from Octree use it too, so that newChild only has to
+	 * call new.
+	 */
+	static void* operator new(size_t size);
+	/*! \brief Frees a node allocated by operator new.
+	 *
+	 * Does nothing for nodes allocated within an arena, the whole arena being
+	 * freed at once by the root.
+	 */
+	static void operator delete(void* ptr);
+
 	/*! \brief Helper function to show and update a progress bar in the terminal
+	 *
+	 * Can be given to \ref setProgressCallback.
 	 *
 	 * \param progress : from 0.0 (0%) to 1.0 (100%)
 	 */
@@ -411,6 +919,10 @@ class Octree
 	/*! \brief Address within a file where lies or should lie the data.
 	 */
 	int64_t file_addr = -2;
+	/*! \brief Size in bytes of the chunk at \ref file_addr, set along with
+	 * it when the chunk is written (or read from the node table of a file).
+	 */
+	uint64_t chunkSize = 0;
 
 	/*! \brief Min value of the positions' x component.
 	 *
@@ -468,6 +980,19 @@ class Octree
 	                                    nullptr, nullptr, nullptr, nullptr}};
 
   private:
+	// Key of this node's random generator, derived from the seed and the path
+	// from the root (only used during construction).
+	uint64_t samplingKey = 0;
+	// Creates children[i] with newChild() within commonData.arena and derives
+	// its samplingKey.
+	Octree* createChild(unsigned int i);
+
+	// Calls token(t) for each 64bit int of getCompactData(), except the first
+	// parenthesis if this node isn't a leaf, followed by a closing parenthesis
+	// if it is. The tree is walked iteratively.
+	template <typename Callback>
+	void forEachStructureToken(Callback const& token) const;
+
 	/*! \brief Converts bounding box to 3 uint_64t.
 	 *
 	 * Used to represent the bounding box in compact data.
@@ -480,50 +1005,78 @@ class Octree
 
 	// init helper that only uses data from beg to end (included).
 	// beg and end are vertices indices.
-	void init(std::vector<float>& data, size_t beg, size_t end, unsigned int maxLeafSize);
-	// init helper that better uses CPU but doubles RAM usage
-	void initParallel(std::vector<float>* data, size_t beg, size_t end, unsigned int maxLeafSize);
-	static unsigned int threadsLaunched;
-	static std::mutex threadsLaunchedMutex;
-	static size_t verticesLoaded;
-	static std::mutex verticesLoadedMutex;
+	void init(float* data, size_t beg, size_t end, unsigned int maxLeafSize);
+	// init helper that submits the big enough subtrees to pool instead of
+	// constructing them itself
+	void initParallel(ThreadPool& pool, float* data, size_t beg, size_t end,
+	                  unsigned int maxLeafSize);
+	// initMorton helper that constructs the node holding vertices beg to end
+	// (included), which all share the same key prefix up to level.
+	void initMortonNode(ThreadPool& pool, float* data,
+	                    std::vector<uint64_t> const& keys, unsigned int level,
+	                    size_t beg, size_t end, unsigned int maxLeafSize);
+	// Computes this node's bounding box and own data from vertices beg to end
+	// (included) and reorders them so that each child's vertices are
+	// contiguous. Returns false if this node is a leaf. Otherwise, child i gets
+	// the childrenSize[i] vertices starting at childrenBeg[i]. If pool isn't
+	// nullptr, it is used to process big nodes.
+	bool initNode(float* data, size_t beg, size_t end,
+	              unsigned int maxLeafSize, size_t childrenBeg[8],
+	              size_t childrenSize[8], ThreadPool* pool = nullptr);
+	// Computes this node's bounding box and own data (references the vertices
+	// for a leaf, LOD sample otherwise) from vertices beg to end (included).
+	// Returns false if this node is a leaf. If pool isn't nullptr, big nodes
+	// are processed by blocks in parallel.
+	bool initNodeData(float* data, size_t beg, size_t end,
+	                  unsigned int maxLeafSize, ThreadPool* pool = nullptr);
+	// Expresses own data relatively to the bounding box if NORMALIZED_NODES is
+	// set.
+	void normalizeOwnData();
+	// initOutOfCore helper that constructs this node from the vertices within
+	// bucket (a temporary file that gets removed) and writes its chunks to
+	// chunks. Subtrees of at most maxInMemory vertices are constructed in
+	// memory.
+	void initOutOfCoreNode(ThreadPool& pool, std::ostream& chunks,
+	                       OutOfCoreBucket& bucket, unsigned int maxLeafSize,
+	                       size_t maxInMemory,
+	                       std::function<std::string()> const& newTmpFile);
+	// Frees the data of the whole subtree (keeps its structure).
+	void releaseData();
+	// Adds offset to the file_addr of the whole subtree.
+	void shiftFileAddresses(int64_t offset);
+	// Derives the samplingKey of the whole subtree from this node's one, as
+	// createChild would.
+	void deriveSamplingKeys();
+	// append helper that inserts vertices beg to end (included) into this
+	// node and its subtree, and writes the chunks of the touched nodes at the
+	// end of file.
+	void appendNode(std::iostream& file, float* data, size_t beg, size_t end,
+	                unsigned int maxLeafSize);
+	// Moves the chunks of the subtree whose address is below maxAddress to
+	// the end of file.
+	void relocateChunks(std::iostream& file, int64_t maxAddress);
+	// init(std::istream&) helper that parses the structure following this
+	// node's file address up to its closing parenthesis, iteratively. It is
+	// read by blocks, in one block if structureEnd (the address of the chunks)
+	// is positive.
+	void initStructure(std::istream& in, int64_t structureEnd);
+	// Sets the chunkSize of the whole tree from the node table at address
+	// within in (the tree being initialized from in).
+	void readChunkSizes(std::istream& in, int64_t address);
+	// Returns the nodes of the tree in the order their chunks are written
+	// (see ChunkOrder).
+	std::vector<Octree*> getNodesInChunkOrder();
 
 	// Gets a vertex's component from data.
 	// vertex is the vertex's index.
 	// (get(data, 10, 1) will return the y component of the 11th vertex.)
-	float get(std::vector<float> const& data, size_t vertex, unsigned int dim);
-	// Sets a vertex component in data (see get for indexing).
-	void set(std::vector<float>& data, size_t vertex, unsigned int dim,
-	         float val);
-	// Swaps two vertices from data, the (i+1)th and the (j+1)th.
-	// This swaps all components of the vertices (x, y, z).
-	void swap(std::vector<float>& data, size_t i, size_t j);
-	// Considers only dim's component of vertices from vertex indices beg to
-	// end. All vertices which value is bellow pivot will be sorted to be before
-	// all vertices which value is above or equal to pivot. This is a partial
-	// sort that splits the data into two parts : one below pivot and one above.
-	// This partial sort is O(end-beg).
-	// The split's index is returned and is the first index of the second part.
-	//
-	// ex :
-	// orderPivot({4, x, x, 5, x, x, 1, x, x, 2, x, x, 3, x, x, 0, x, x, 6,
-	// x, x}, 0, 6, 0, 3.5)
-	// will reorder the data as :
-	// {0, x, x, 3, x, x, 1, x, x, 2, x, x, 5, x, x 4, x, x, 6, x, x}
-	// and return 4
-	// x aren't important for this example but they are the other two components
-	// of the vertices and will be moved along with the first component.
-	// Vertices data is always conserved and triplets are always moved together.
-	size_t orderPivot(std::vector<float>& data, size_t beg, size_t end,
-	                  unsigned int dim, float pivot);
+	float get(float const* data, size_t vertex, unsigned int dim);
 
 	// to write LIBOCTREE.debug which holds the ASCII-translated compact data of
 	// the tree
 	static std::string tabs;
 	static std::ofstream debug;
 
-	static size_t totalNumberOfVertices;
-
 	// versioned file reading methods
 	void init1_0(std::istream& in);
 	void init2_0(std::istream& in);
@@ -546,6 +1099,19 @@ class Octree
  */
 void write(std::ostream& stream, Octree& octree);
 
+/*! \brief Writes an Octree in the file at \p path.
+ *  \relates Octree
+ *
+ * Same as \ref write(std::ostream&, Octree&) with a truncated file, but the
+ * data chunks are written concurrently (see \ref
+ * Octree::writeData(std::string const&, int64_t)). Throws a std::string if
+ * the file can't be written.
+ *
+ * \param path : path of the file in which to write
+ * \param octree : octree to be written
+ */
+void write(std::string const& path, Octree& octree);
+
 /*! \brief Returns bitwise NOT value of a flag, considering it is equivalent to
  * uint64_t.
  */
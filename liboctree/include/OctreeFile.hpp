@@ -0,0 +1,152 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef OCTREEFILE_H
+#define OCTREEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LinearOctree.hpp"
+
+/*! \brief Read-only octree file mapped in memory.
+ *
+ * The structure of the file is read as a \ref LinearOctree, and the file is
+ * mapped in memory (read in memory on Windows) so that the chunks are read
+ * without any system call. The data of a node is given out as a \ref Span
+ * that points directly within the mapping if its chunk isn't encoded (see
+ * \ref isZeroCopy) : reading the same node again only costs page cache hits,
+ * without any allocation nor copy.
+ */
+class OctreeFile
+{
+  public:
+	/*! \brief Index of a node within \ref getTree.
+	 */
+	typedef LinearOctree::Index Index;
+
+	/*! \brief Read-only view of contiguous floats.
+	 */
+	struct Span
+	{
+		/*! \brief First float of the view.
+		 */
+		float const* data;
+		/*! \brief Number of floats of the view.
+		 */
+		size_t size;
+
+		float const* begin() const { return data; };
+		float const* end() const { return data + size; };
+		float operator[](size_t i) const { return data[i]; };
+		bool empty() const { return size == 0; };
+	};
+
+	/*! \brief Expected access pattern, see \ref advise.
+	 */
+	enum class Advice
+	{
+		/*! \brief No particular pattern (default read-ahead).
+		 */
+		NORMAL,
+		/*! \brief Pages will be read in increasing order (aggressive
+		 * read-ahead).
+		 */
+		SEQUENTIAL,
+		/*! \brief Pages will be read in random order (no read-ahead).
+		 */
+		RANDOM,
+		/*! \brief Pages will be read soon, they are read ahead in the
+		 * background.
+		 */
+		WILLNEED,
+		/*! \brief Pages won't be read soon, the page cache can drop them.
+		 */
+		DONTNEED,
+	};
+
+	OctreeFile() = default;
+	OctreeFile(OctreeFile const&) = delete;
+	OctreeFile& operator=(OctreeFile const&) = delete;
+
+	/*! \brief Maps the octree file at \p path and reads its structure.
+	 *
+	 * Closes the previously opened file if any. Throws a std::string if the
+	 * file can't be opened or read.
+	 */
+	void open(std::string const& path);
+	/*! \brief Unmaps the file. The spans given out become invalid.
+	 */
+	void close();
+	/*! \brief Returns true if a file is opened.
+	 */
+	bool isOpen() const { return mapping != nullptr; };
+
+	/*! \brief Returns the structure of the file.
+	 */
+	LinearOctree const& getTree() const { return tree; };
+
+	/*! \brief Returns true if \ref getData gives out views within the
+	 * mapping (but for misaligned chunks).
+	 *
+	 * Chunks need to be decoded when the file has the COMPRESSED_CHUNKS or
+	 * QUANTIZED_POSITIONS \ref Octree::Flags.
+	 */
+	bool isZeroCopy() const;
+
+	/*! \brief Returns the data of \p node, as \ref LinearOctree::readChunk.
+	 *
+	 * \p buffer is only used if the chunk is encoded (see \ref isZeroCopy) or
+	 * misaligned (only in hand-made files) : the chunk is then decoded or
+	 * copied in \p buffer, which the returned span points to. Otherwise, the
+	 * span points within the mapping and stays valid until the file is closed.
+	 *
+	 * Throws a std::string if the chunk is invalid.
+	 */
+	Span getData(Index node, std::vector<float>& buffer) const;
+
+	/*! \brief Tells the system how the whole file will be accessed (see
+	 * madvise(2)). Does nothing on Windows.
+	 */
+	void advise(Advice advice) const;
+	/*! \brief Tells the system how the chunk of \p node will be accessed, to
+	 * read it ahead with Advice::WILLNEED for example.
+	 */
+	void advise(Index node, Advice advice) const;
+
+	~OctreeFile();
+
+  private:
+	// Returns the offset of the chunk of node within the mapping, after the
+	// bounding box of version 1.0 chunks.
+	size_t getChunkOffset(Index node) const;
+	// Returns the size in bytes of the chunk of node (without its
+	// version 1.0 bounding box).
+	size_t getChunkSize(Index node) const;
+	void advise(size_t offset, size_t size, Advice advice) const;
+
+	LinearOctree tree;
+	char const* mapping = nullptr;
+	size_t mappingSize  = 0;
+	// holds the file instead of the mapping on Windows
+	std::vector<char> content;
+};
+
+#endif // OCTREEFILE_H
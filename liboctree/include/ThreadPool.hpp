@@ -0,0 +1,115 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! \brief Fixed-size work-stealing thread pool.
+ *
+ * Each worker owns a task queue. Tasks submitted from a worker thread are
+ * pushed to its own queue and popped in LIFO order (depth-first, cache
+ * friendly), while idle workers steal the oldest tasks of other queues (which
+ * are typically the biggest subtrees). Tasks submitted from outside the pool
+ * are distributed among the queues in a round-robin fashion.
+ *
+ * It is used by \ref Octree to construct subtrees concurrently without
+ * creating one thread per node.
+ */
+class ThreadPool
+{
+  public:
+	/*! \brief Constructs a pool and starts its workers.
+	 *
+	 * \param threadsNumber : number of worker threads. If 0, uses
+	 * std::thread::hardware_concurrency().
+	 */
+	explicit ThreadPool(unsigned int threadsNumber = 0);
+
+	ThreadPool(ThreadPool const& other)            = delete;
+	ThreadPool& operator=(ThreadPool const& other) = delete;
+
+	/*! \brief Returns the number of worker threads of the pool.
+	 */
+	unsigned int getThreadsNumber() const { return threads.size(); };
+
+	/*! \brief Schedules \p task for execution by one of the workers.
+	 *
+	 * Can be called from any thread, including from within a running task.
+	 */
+	void submit(std::function<void()> task);
+
+	/*! \brief Runs \p task(i) for each i from 0 to \p tasksNumber - 1 on the
+	 * pool and returns once they are all done.
+	 *
+	 * Can be called from within a task of this pool, in which case the calling
+	 * worker executes pending tasks while waiting instead of blocking.
+	 */
+	void parallelFor(size_t tasksNumber,
+	                 std::function<void(size_t)> const& task);
+
+	/*! \brief Blocks until all submitted tasks are done, including the tasks
+	 * they submitted themselves.
+	 *
+	 * \attention Must not be called from within a task of this pool.
+	 */
+	void waitForAll();
+
+	/*! \brief Stops the workers once all the submitted tasks are done.
+	 */
+	~ThreadPool();
+
+  private:
+	struct Queue
+	{
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	// tasks submitted but not finished yet
+	std::atomic<size_t> pendingTasks;
+	// tasks submitted but not started yet
+	std::atomic<size_t> queuedTasks;
+	std::atomic<unsigned int> nextQueue;
+
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable allDone;
+	bool stop = false;
+
+	// Worker index of the current thread within currentPool (if any)
+	static thread_local ThreadPool* currentPool;
+	static thread_local unsigned int currentWorker;
+
+	bool popOrSteal(unsigned int worker, std::function<void()>& task);
+	void run(std::function<void()>& task);
+	void workerLoop(unsigned int worker);
+};
+
+#endif // THREADPOOL_H
@@ -19,6 +19,8 @@
 #ifndef BINARYRW_H
 #define BINARYRW_H
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
@@ -96,6 +98,26 @@ inline void write(std::ostream& stream, T& x, size_t n = 1);
 template <typename T>
 inline void read(std::istream& stream, T& res, size_t n = 1);
 
+/*! \brief Copies a base-type value to a buffer in the byte order of the
+ * files.
+ *
+ * Same as \ref write for a value built in memory, for example within a buffer
+ * written at once.
+ *
+ * \param buffer : where to copy the sizeof(T) bytes of \p x
+ * \param x : the value to copy
+ */
+template <typename T>
+inline void store(char* buffer, T const& x);
+
+/*! \brief Copies a base-type value from a buffer filled by \ref store.
+ *
+ * \param buffer : where to copy the sizeof(T) bytes of \p res from
+ * \param res : the value to set
+ */
+template <typename T>
+inline void load(char const* buffer, T& res);
+
 /*! \brief Writes a vector of base-type.
  *
  * The size of the vector will also be written, which is useful for reading.
@@ -175,6 +197,26 @@ void read(std::istream& stream, T& res, size_t n)
 	}
 }
 
+template <typename T>
+void store(char* buffer, T const& x)
+{
+	char const* bytes(reinterpret_cast<char const*>(&x));
+	if(isLittleEndian())
+		std::memcpy(buffer, bytes, sizeof(T));
+	else
+		std::reverse_copy(bytes, bytes + sizeof(T), buffer);
+}
+
+template <typename T>
+void load(char const* buffer, T& res)
+{
+	char* bytes(reinterpret_cast<char*>(&res));
+	if(isLittleEndian())
+		std::memcpy(bytes, buffer, sizeof(T));
+	else
+		std::reverse_copy(buffer, buffer + sizeof(T), bytes);
+}
+
 template <typename T>
 void write(std::ostream& stream, std::vector<T>& vec)
 {
@@ -0,0 +1,100 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+/*! \brief Encoding of the chunks of octree files having the \ref
+ * Octree::Flags COMPRESSED_CHUNKS or QUANTIZED_POSITIONS flags.
+ *
+ * Such a chunk is made of the number of floats it holds (SIZE, 64 bits), the
+ * \ref Codec used to encode them (64 bits), the number of bytes they are
+ * encoded with (64 bits), then these bytes. The floats are those an
+ * uncompressed chunk would hold.
+ *
+ * \ref Codec::BITSHUFFLE_RLE transposes the bits of the floats of each vertex
+ * component, so that the bits they have in common (sign, exponent and highest
+ * bits of the mantissa within a node) end up in runs of identical bytes, which
+ * are then run-length encoded. It doesn't need any dependency. With SSE2, a
+ * chunk of 16000 vertices decodes at about 1 GB/s and encodes at about
+ * 0.4 GB/s on a single core of a recent x86-64 processor (about half as fast
+ * without SSE2).
+ *
+ * \ref Codec::QUANTIZED_POSITIONS is lossy : it stores positions within [0, 1]
+ * (the ones of normalized nodes) as 16-bit fixed-point numbers.
+ */
+namespace codec
+{
+/*! \brief How the floats of a chunk are encoded.
+ */
+enum class Codec : uint64_t
+{
+	/*! \brief Floats as is (used when encoding them doesn't save space).
+	 */
+	RAW = 0,
+	/*! \brief Bit transposition by groups of 8 vertices followed by
+	 * run-length encoding.
+	 */
+	BITSHUFFLE_RLE = 1,
+	/*! \brief Positions of the vertices as 16-bit unsigned integers (0 for
+	 * 0.0, 65535 for 1.0, values are clamped to [0, 1]) followed by their
+	 * other components as floats.
+	 */
+	QUANTIZED_POSITIONS = 2,
+};
+
+/*! \brief Size in bytes of what precedes the encoded floats in a chunk.
+ */
+const size_t chunkHeaderSize = 3 * sizeof(uint64_t);
+
+/*! \brief Encodes the \p size floats of \p data (made of vertices of
+ * \p dimPerVertex components) as a whole chunk in \p chunk.
+ *
+ * Uses \ref Codec::QUANTIZED_POSITIONS if \p quantizePositions is true,
+ * else \ref Codec::BITSHUFFLE_RLE if \p compress is true and it saves space,
+ * \ref Codec::RAW otherwise.
+ */
+void encodeChunk(float const* data, size_t size, unsigned int dimPerVertex,
+                 bool compress, bool quantizePositions,
+                 std::vector<char>& chunk);
+
+/*! \brief Reads a chunk written by \ref encodeChunk from \p in and decodes
+ * its floats in \p data.
+ *
+ * Throws a std::string if the chunk is invalid or can't be read.
+ */
+void readChunk(std::istream& in, unsigned int dimPerVertex,
+               std::vector<float>& data);
+
+/*! \brief Same as \ref readChunk from a chunk in memory, of which at most
+ * \p available bytes can be read.
+ *
+ * The encoded floats are decoded from where they are, without being copied
+ * first.
+ */
+void decodeChunk(char const* chunk, size_t available,
+                 unsigned int dimPerVertex, std::vector<float>& data);
+} // namespace codec
+
+#endif // CODEC_H
@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*! \brief Low-level loops over interleaved vertex data used during octree
+ * construction and reading.
+ *
+ * Vertex data is structured as follows for N vertices of D components :
+ * {x1, y1, z1, ... (D - 3 other components), ... xN, yN, zN, ...}. Vertex
+ * indices go from 0 to N - 1 and ranges are given as [beg, end] (included),
+ * like within \ref Octree.
+ *
+ * Each function dispatches at runtime to a version compiled for the given
+ * number of components per vertex if it is a common one (3, 4, 5, 6, 7, 9 or
+ * 10, which are the possible \ref Octree::Flags STORE_* combinations used by
+ * octreegen), so that vertices are moved with fixed-size copies and without
+ * any allocation.
+ */
+namespace kernels
+{
+/*! \brief Extends a bounding box with the positions of vertices \p beg to
+ * \p end.
+ *
+ * On x86 processors, uses AVX2 or SSE2 instructions if they are available
+ * (checked at runtime).
+ *
+ * \param bbox : {minX, maxX, minY, maxY, minZ, maxZ}, to be updated
+ */
+void boundingBox(float const* data, unsigned int dimPerVertex, size_t beg,
+                 size_t end, float bbox[6]);
+
+/*! \brief Reorders vertices \p beg to \p end by octant in a single pass.
+ *
+ * The octant of a vertex is made of 3 bits (x, y, z), each one being set if the
+ * corresponding coordinate is above or equal to the one of \p mid. The
+ * vertices are counted per octant, then moved in place by following the
+ * permutation cycles. Octant o then holds the \p octantsSize[o] vertices
+ * starting at \p octantsBeg[o].
+ */
+void partitionOctants(float* data, unsigned int dimPerVertex, size_t beg,
+                      size_t end, float const mid[3], size_t octantsBeg[8],
+                      size_t octantsSize[8]);
+
+/*! \brief Reorders vertices \p beg to \p end so that the ones whose
+ * \p axis coordinate is below \p mid come first.
+ *
+ * Like within \ref partitionOctants, vertices whose coordinate is NaN are
+ * considered above.
+ *
+ * \param axis : 0, 1 or 2 for x, y or z
+ * \return the number of vertices below \p mid
+ */
+size_t partitionAxis(float* data, unsigned int dimPerVertex, size_t beg,
+                     size_t end, unsigned int axis, float mid);
+
+/*! \brief Converts the \p size 16-bit fixed-point numbers of \p quantized
+ * to floats within [0, 1] in \p data (65535 giving 1.0).
+ *
+ * On x86 processors, uses AVX2 or SSE2 instructions if they are available
+ * (checked at runtime). The results don't depend on the instructions used.
+ */
+void dequantize(uint16_t const* quantized, size_t size, float* data);
+
+/*! \brief Instructions the functions above can use on x86 processors.
+ */
+enum class InstructionSet
+{
+	SCALAR,
+	SSE2,
+	AVX2
+};
+
+/*! \brief Prevents the functions above from using better instructions than
+ * \p instructionSet (AVX2 by default), even if the processor supports them.
+ *
+ * Mostly useful to test each version on the same processor. It must not be
+ * called while other threads use these functions. Does nothing on other
+ * processors than x86 ones, which always use the scalar version.
+ */
+void setMaxInstructionSet(InstructionSet instructionSet);
+} // namespace kernels
+
+#endif // KERNELS_H
@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+/*! \brief Morton codes (Z-order curve) computation and sorting.
+ *
+ * A Morton code interleaves the bits of three integer coordinates. Sorting
+ * points by Morton code puts the points of each octree node (on a regular
+ * grid) in a contiguous range, sub-nodes being themselves contiguous and
+ * ordered within it.
+ *
+ * Used by \ref Octree::initMorton.
+ */
+namespace morton
+{
+/*! \brief Number of bits per coordinate within a code.
+ */
+const unsigned int bitsPerAxis = 21;
+
+/*! \brief Returns the Morton code of integer coordinates (\p x, \p y, \p z).
+ *
+ * Only the \ref bitsPerAxis lowest bits of each coordinate are used. Within
+ * each 3 bits triplet of the result, the x bit is the highest and the z bit the
+ * lowest.
+ */
+uint64_t encode(uint32_t x, uint32_t y, uint32_t z);
+
+/*! \brief Returns the 3 bits (x, y, z) of a code at a given tree \p level.
+ *
+ * Level 0 is the root's split, level \ref bitsPerAxis - 1 the finest one.
+ */
+inline unsigned int octant(uint64_t key, unsigned int level)
+{
+	return (key >> (3 * (bitsPerAxis - 1 - level))) & 7;
+}
+
+/*! \brief Sorts \p keys in increasing order and reorders \p indices the same
+ * way.
+ *
+ * This is a parallel LSD radix sort (8 bits per pass) which skips the passes
+ * on bytes that are the same for all keys. It needs as much temporary memory
+ * as \p keys and \p indices.
+ *
+ * \param pool : pool on which to run the sort
+ * \param keys : keys to sort
+ * \param indices : values attached to the keys (same size as \p keys)
+ */
+void radixSort(ThreadPool& pool, std::vector<uint64_t>& keys,
+               std::vector<size_t>& indices);
+} // namespace morton
+
+#endif // MORTON_H
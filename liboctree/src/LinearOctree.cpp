@@ -0,0 +1,303 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "LinearOctree.hpp"
+
+#include <array>
+#include <bitset>
+#include <string>
+
+#include "binaryrw.hpp"
+#include "codec.hpp"
+
+namespace
+{
+const size_t noParsedNode = SIZE_MAX;
+
+// Node as read from the file, before the tree is laid out in breadth-first
+// order.
+struct ParsedNode
+{
+	LinearOctree::Node node;
+	// indices of the children within the parsed nodes
+	std::array<size_t, 8> children;
+};
+
+void readBBox(std::istream& in, LinearOctree::Node& node)
+{
+	brw::read(in, node.minX);
+	brw::read(in, node.maxX);
+	brw::read(in, node.minY);
+	brw::read(in, node.maxY);
+	brw::read(in, node.minZ);
+	brw::read(in, node.maxZ);
+}
+
+// Reads a node whose file_addr has already been read from the structure, then
+// its children if hasChildren (up to the closing parenthesis). Nodes are
+// appended to parsed in depth-first order. Returns the index of the node.
+size_t parseNode(std::istream& in, uint32_t versionMajor, int64_t file_addr,
+                 bool hasChildren, std::vector<ParsedNode>& parsed)
+{
+	ParsedNode p;
+	p.node.file_addr = file_addr;
+	p.node.chunkSize = 0;
+	p.children.fill(noParsedNode);
+	if(versionMajor < 2)
+	{
+		// bounding box and size are at the beginning of the chunk
+		int64_t cursor(in.tellg());
+		in.seekg(file_addr);
+		readBBox(in, p.node);
+		brw::read(in, p.node.totalDataSize);
+		in.seekg(cursor);
+	}
+	else
+	{
+		brw::read(in, p.node.totalDataSize);
+		readBBox(in, p.node);
+	}
+	if(!in)
+		throw(std::string("Unexpected end of octree file structure"));
+
+	size_t index(parsed.size());
+	parsed.push_back(p);
+	if(!hasChildren)
+		return index;
+
+	uint64_t childrenDataSize(0);
+	bool hasChild(false);
+	unsigned int i(0);
+	while(true)
+	{
+		int64_t readVal;
+		brw::read(in, readVal);
+		if(!in)
+			throw(std::string("Unexpected end of octree file structure"));
+		if(readVal == 1) //) <= own end
+			break;
+		if(i == 8)
+			throw(std::string("Invalid octree file structure : more than 8 "
+			                  "children"));
+
+		size_t child(noParsedNode);
+		if(readVal == 0) //( <= sub node
+		{
+			int64_t childAddr;
+			brw::read(in, childAddr);
+			child = parseNode(in, versionMajor, childAddr, true, parsed);
+		}
+		else if(readVal != -1) // null node
+		{
+			child = parseNode(in, versionMajor, readVal, false, parsed);
+		}
+		if(child != noParsedNode)
+		{
+			childrenDataSize += parsed[child].node.totalDataSize;
+			hasChild = true;
+		}
+		parsed[index].children[i] = child;
+		++i;
+	}
+	// like Octree::init(std::istream&), the total data size of a node with
+	// children is the sum of its children's
+	if(hasChild)
+		parsed[index].node.totalDataSize = childrenDataSize;
+	return index;
+}
+
+// Reads the nodes from the node table at address within in. They are in the
+// same order as within a LinearOctree.
+void readNodeTable(std::istream& in, int64_t address,
+                   std::vector<LinearOctree::Node>& nodes)
+{
+	const size_t entrySize(Octree::nodeTableEntrySize);
+	in.seekg(address);
+	uint64_t nodesNumber;
+	brw::read(in, nodesNumber);
+	if(!in || nodesNumber == 0 || nodesNumber >= LinearOctree::noNode)
+		throw(std::string("Invalid octree file node table"));
+	std::vector<char> table(nodesNumber * entrySize);
+	in.read(table.data(), table.size());
+	if(!in)
+		throw(std::string("Unexpected end of octree file node table"));
+
+	nodes.resize(nodesNumber);
+	for(size_t i(0); i < nodes.size(); ++i)
+	{
+		char const* entry(&table[i * entrySize]);
+		LinearOctree::Node& node(nodes[i]);
+		float bbox[6];
+		uint32_t childMask;
+		brw::load(entry, node.file_addr);
+		brw::load(entry + 8, node.chunkSize);
+		brw::load(entry + 16, node.totalDataSize);
+		for(unsigned int k(0); k < 6; ++k)
+			brw::load(entry + 24 + 4 * k, bbox[k]);
+		brw::load(entry + 48, node.firstChild);
+		brw::load(entry + 52, childMask);
+		node.minX = bbox[0];
+		node.maxX = bbox[1];
+		node.minY = bbox[2];
+		node.maxY = bbox[3];
+		node.minZ = bbox[4];
+		node.maxZ = bbox[5];
+		// children come after their parent, which keeps traversals finite
+		if(childMask > 0xFF
+		   || (childMask != 0
+		       && (node.firstChild <= i
+		           || node.firstChild + std::bitset<8>(childMask).count()
+		                  > nodesNumber)))
+			throw(std::string("Invalid octree file node table"));
+		node.childMask = childMask;
+	}
+}
+} // namespace
+
+const LinearOctree::Index LinearOctree::root;
+const LinearOctree::Index LinearOctree::noNode;
+
+void LinearOctree::init(std::istream& in)
+{
+	nodes.clear();
+
+	int64_t file_addr;
+	brw::read(in, file_addr);
+	int64_t nodeTableAddress(0);
+
+	// if file_addr is negative, we are at the beginning of the file and there
+	// are flags to read
+	flags          = Octree::Flags::NONE;
+	versionMajor   = VERSION_MAJOR;
+	versionMinor   = VERSION_MINOR;
+	chunkAlignment = 1;
+	if(file_addr < 0)
+	{
+		versionMajor = 0;
+		versionMinor = 0;
+		brw::read(in, flags);
+		if((flags & Octree::Flags::VERSIONED) != Octree::Flags::NONE)
+		{
+			brw::read(in, versionMajor);
+			brw::read(in, versionMinor);
+			if(versionMajor > VERSION_MAJOR
+			   || (versionMajor == VERSION_MAJOR
+			       && versionMinor > VERSION_MINOR))
+			{
+				throw("Octree file format version "
+				      + std::to_string(versionMajor) + "."
+				      + std::to_string(versionMinor)
+				      + " is not supported by this version of liboctree");
+			}
+		}
+		if(versionMajor == 2 && versionMinor >= 1)
+		{
+			brw::read(in, chunkAlignment);
+		}
+		if(versionMajor == 2 && versionMinor >= 4
+		   && (flags & Octree::Flags::NODE_TABLE) != Octree::Flags::NONE)
+		{
+			brw::read(in, nodeTableAddress);
+		}
+		brw::read(in, file_addr);
+	}
+	if(!in)
+		throw(std::string("Unexpected end of octree file header"));
+	dimPerVertex = Octree::getDimPerVertex(flags);
+	if(nodeTableAddress != 0)
+	{
+		readNodeTable(in, nodeTableAddress, nodes);
+		return;
+	}
+
+	std::vector<ParsedNode> parsed;
+	parseNode(in, versionMajor, file_addr, true, parsed);
+	if(parsed.size() >= noNode)
+		throw(std::string("Too many nodes for a LinearOctree"));
+
+	// breadth-first layout : the children of nodes[i] are appended when
+	// nodes[i] is reached, so they are contiguous and come after all the nodes
+	// of the previous levels
+	nodes.reserve(parsed.size());
+	std::vector<size_t> parsedIndices;
+	parsedIndices.reserve(parsed.size());
+	nodes.push_back(parsed[0].node);
+	parsedIndices.push_back(0);
+	for(size_t i(0); i < nodes.size(); ++i)
+	{
+		ParsedNode const& p(parsed[parsedIndices[i]]);
+		nodes[i].firstChild = nodes.size();
+		nodes[i].childMask  = 0;
+		for(unsigned int c(0); c < 8; ++c)
+		{
+			if(p.children[c] == noParsedNode)
+				continue;
+			nodes[i].childMask |= 1 << c;
+			nodes.push_back(parsed[p.children[c]].node);
+			parsedIndices.push_back(p.children[c]);
+		}
+	}
+}
+
+LinearOctree::Index LinearOctree::getChild(Index node, unsigned int i) const
+{
+	Node const& n(nodes[node]);
+	if((n.childMask & (1 << i)) == 0)
+		return noNode;
+	return n.firstChild
+	       + std::bitset<8>(n.childMask & ((1 << i) - 1)).count();
+}
+
+void LinearOctree::traverse(std::function<bool(Index)> const& visitor) const
+{
+	if(nodes.empty())
+		return;
+
+	std::vector<Index> stack;
+	stack.push_back(root);
+	while(!stack.empty())
+	{
+		Index i(stack.back());
+		stack.pop_back();
+		if(!visitor(i) || nodes[i].isLeaf())
+			continue;
+		// push in reverse order so that child 0 is visited first
+		for(Index c(nodes[i].firstChild + nodes[i].childrenNumber());
+		    c > nodes[i].firstChild; --c)
+			stack.push_back(c - 1);
+	}
+}
+
+std::vector<float> LinearOctree::readChunk(std::istream& in, Index node) const
+{
+	int64_t file_addr(nodes[node].file_addr);
+	// version 1.0 chunks begin with the bounding box
+	if(versionMajor < 2)
+		file_addr += 6 * sizeof(float);
+	in.seekg(file_addr);
+	std::vector<float> result;
+	if(Octree::hasChunkCodec(flags))
+	{
+		codec::readChunk(in, dimPerVertex, result);
+		return result;
+	}
+	brw::read(in, result);
+	if(!in)
+		throw(std::string("Unexpected end of octree file chunk"));
+	return result;
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "NodeArena.hpp"
+
+#include <atomic>
+#include <new>
+
+namespace
+{
+std::atomic<uint64_t> nextArenaId(0);
+
+// Current block of the calling thread, within the arena arenaId.
+struct ThreadBlock
+{
+	uint64_t arenaId = UINT64_MAX;
+	char* cur        = nullptr;
+	char* end        = nullptr;
+};
+
+thread_local ThreadBlock threadBlock;
+} // namespace
+
+NodeArena::NodeArena()
+    : id(nextArenaId++)
+{
+}
+
+void* NodeArena::allocate(size_t size)
+{
+	size = (size + alignment - 1) / alignment * alignment;
+
+	// big allocations get their own block to not waste the current one
+	if(size > blockSize / 4)
+		return newBlock(size);
+
+	ThreadBlock& block(threadBlock);
+	if(block.arenaId != id || static_cast<size_t>(block.end - block.cur) < size)
+	{
+		block.arenaId = id;
+		block.cur     = newBlock(blockSize);
+		block.end     = block.cur + blockSize;
+	}
+	void* result(block.cur);
+	block.cur += size;
+	return result;
+}
+
+NodeArena::~NodeArena()
+{
+	for(char* block : blocks)
+		::operator delete(block);
+}
+
+char* NodeArena::newBlock(size_t size)
+{
+	// ::operator new returns addresses aligned for any fundamental type
+	char* block(static_cast<char*>(::operator new(size)));
+	std::lock_guard<std::mutex> lock(blocksMutex);
+	blocks.push_back(block);
+	return block;
+}
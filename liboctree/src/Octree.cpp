@@ -18,20 +18,505 @@
 
 #include "Octree.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "NodeArena.hpp"
+#include "ThreadPool.hpp"
+#include "codec.hpp"
+#include "kernels.hpp"
+#include "morton.hpp"
+
+namespace
+{
+// Arena in which Octree::operator new allocates nodes on this thread (heap if
+// nullptr), set by Octree::createChild.
+thread_local NodeArena* allocationArena = nullptr;
+
+// splitmix64 finalizer : a bijection on 64 bits integers whose outputs look
+// independent even for consecutive inputs.
+uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+// Counter-based generator : returns the counter-th random 64 bits integer of
+// the stream identified by key. No state is shared, so the numbers don't
+// depend on the order in which they are drawn.
+uint64_t random(uint64_t key, uint64_t counter)
+{
+	return mix(key + (counter + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+// Maps a random 64 bits integer to a uniform number in [0, 1).
+float toUniform(uint64_t random)
+{
+	return (random >> 40) * (1.f / (1 << 24));
+}
+
+// Estimates the median of each position component of vertices beg to end
+// (included) from at most 1023 of them, evenly spaced.
+void medianPosition(float const* data, unsigned int dimPerVertex, size_t beg,
+                    size_t end, float median[3])
+{
+	const size_t verticesNumber(end - beg + 1);
+	const size_t samplesNumber(
+	    std::min(verticesNumber, static_cast<size_t>(1023)));
+	std::vector<float> values(samplesNumber);
+	for(unsigned int c(0); c < 3; ++c)
+	{
+		for(size_t j(0); j < samplesNumber; ++j)
+		{
+			size_t vertex(beg + j * verticesNumber / samplesNumber);
+			values[j] = data[vertex * dimPerVertex + c];
+		}
+		std::nth_element(values.begin(), values.begin() + samplesNumber / 2,
+		                 values.end());
+		median[c] = values[samplesNumber / 2];
+	}
+}
+
+// Nodes having at least this number of vertices are partitioned by blocks
+// of partitionBlockSize vertices, which can be processed in parallel. The
+// blocks don't depend on the number of threads, so that vertices end up in the
+// same order whatever it is.
+const size_t parallelPartitionThreshold(1 << 20);
+const size_t partitionBlockSize(1 << 16);
+
+// Runs task(i) for each i from 0 to tasksNumber - 1, on pool if any.
+void forEachBlock(ThreadPool* pool, size_t tasksNumber,
+                  std::function<void(size_t)> const& task)
+{
+	if(pool != nullptr && tasksNumber > 1)
+	{
+		pool->parallelFor(tasksNumber, task);
+		return;
+	}
+	for(size_t i(0); i < tasksNumber; ++i)
+	{
+		task(i);
+	}
+}
+
+// Same as kernels::partitionAxis for the n vertices starting at beg. Each
+// block is partitioned on its own, then the vertices above mid that lie
+// within the first part of the range are swapped with the vertices below mid
+// that lie within the second part. Both steps are parallel.
+size_t partitionAxis(ThreadPool* pool, float* data, unsigned int dimPerVertex,
+                     size_t beg, size_t n, unsigned int axis, float mid)
+{
+	const size_t blocksNumber((n + partitionBlockSize - 1)
+	                          / partitionBlockSize);
+	std::vector<size_t> blocksBelow(blocksNumber);
+	forEachBlock(pool, blocksNumber, [&](size_t b) {
+		size_t blockBeg(beg + b * partitionBlockSize);
+		size_t blockEnd(std::min(beg + n, blockBeg + partitionBlockSize) - 1);
+		blocksBelow[b] = kernels::partitionAxis(data, dimPerVertex, blockBeg,
+		                                        blockEnd, axis, mid);
+	});
+	size_t below(0);
+	for(size_t blockBelow : blocksBelow)
+	{
+		below += blockBelow;
+	}
+
+	// Misplaced vertices form at most one run per block and per part. The
+	// k-th misplaced vertex of the first part is swapped with the k-th one of
+	// the second part.
+	struct Run
+	{
+		size_t first;
+		size_t size;
+		// misplaced vertices within the previous runs
+		size_t offset;
+	};
+	const size_t split(beg + below);
+	std::vector<Run> aboveRuns, belowRuns;
+	size_t misplaced(0), misplacedBelow(0);
+	for(size_t b(0); b < blocksNumber; ++b)
+	{
+		size_t blockBeg(beg + b * partitionBlockSize);
+		size_t blockStop(std::min(beg + n, blockBeg + partitionBlockSize));
+		size_t blockSplit(blockBeg + blocksBelow[b]);
+		size_t aboveStop(std::min(blockStop, split));
+		if(aboveStop > blockSplit)
+		{
+			aboveRuns.push_back({blockSplit, aboveStop - blockSplit, misplaced});
+			misplaced += aboveStop - blockSplit;
+		}
+		size_t belowFirst(std::max(blockBeg, split));
+		if(blockSplit > belowFirst)
+		{
+			belowRuns.push_back(
+			    {belowFirst, blockSplit - belowFirst, misplacedBelow});
+			misplacedBelow += blockSplit - belowFirst;
+		}
+	}
+
+	auto runOf = [](std::vector<Run> const& runs, size_t k) {
+		return std::upper_bound(runs.begin(), runs.end(), k,
+		                        [](size_t k, Run const& run) {
+			                        return k < run.offset;
+		                        })
+		       - runs.begin() - 1;
+	};
+	forEachBlock(
+	    pool, (misplaced + partitionBlockSize - 1) / partitionBlockSize,
+	    [&](size_t s) {
+		    size_t k(s * partitionBlockSize);
+		    size_t kEnd(std::min(misplaced, k + partitionBlockSize));
+		    size_t a(runOf(aboveRuns, k)), b(runOf(belowRuns, k));
+		    while(k < kEnd)
+		    {
+			    Run const& aboveRun(aboveRuns[a]);
+			    Run const& belowRun(belowRuns[b]);
+			    size_t aboveOffset(k - aboveRun.offset),
+			        belowOffset(k - belowRun.offset);
+			    size_t count(std::min(std::min(aboveRun.size - aboveOffset,
+			                                   belowRun.size - belowOffset),
+			                          kEnd - k));
+			    float* above(data
+			                 + (aboveRun.first + aboveOffset) * dimPerVertex);
+			    std::swap_ranges(above, above + count * dimPerVertex,
+			                     data
+			                         + (belowRun.first + belowOffset)
+			                               * dimPerVertex);
+			    k += count;
+			    if(aboveOffset + count == aboveRun.size)
+				    ++a;
+			    if(belowOffset + count == belowRun.size)
+				    ++b;
+		    }
+	    });
+	return below;
+}
+
+// Same as kernels::partitionOctants, but as three blocked partitions along
+// each axis : x splits the range in two halves, then y each half and z each
+// quarter.
+void partitionOctants(ThreadPool* pool, float* data, unsigned int dimPerVertex,
+                      size_t beg, size_t end, float const mid[3],
+                      size_t octantsBeg[8], size_t octantsSize[8])
+{
+	octantsBeg[0]  = beg;
+	octantsSize[0] = end - beg + 1;
+	for(unsigned int axis(0); axis < 3; ++axis)
+	{
+		// octants o to o + step - 1 are within the range of octant o
+		const unsigned int step(8 >> axis);
+		for(unsigned int o(0); o < 8; o += step)
+		{
+			size_t below(partitionAxis(pool, data, dimPerVertex, octantsBeg[o],
+			                           octantsSize[o], axis, mid[axis]));
+			octantsBeg[o + step / 2]  = octantsBeg[o] + below;
+			octantsSize[o + step / 2] = octantsSize[o] - below;
+			octantsSize[o]            = below;
+		}
+	}
+}
+
+// Bottom-k sample : keeps the k vertices of smallest random priorities, which
+// is a uniform sample of k vertices without replacement. Reservoirs filled
+// from disjoint ranges of vertices can be merged into the reservoir of their
+// union, in any order.
+class Reservoir
+{
+  public:
+	struct Entry
+	{
+		uint64_t priority;
+		// vertex index
+		size_t vertex;
+		// where the vertex is stored by the caller, from 0 to k - 1
+		size_t slot;
+		// the vertex breaks ties
+		bool operator<(Entry const& other) const
+		{
+			return priority < other.priority
+			       || (priority == other.priority && vertex < other.vertex);
+		};
+	};
+
+	explicit Reservoir(size_t k)
+	    : k(k){};
+
+	// Returns the slot in which the vertex has to be stored if it is kept
+	// (replacing the vertex which was stored there), or k otherwise.
+	size_t offer(uint64_t priority, size_t vertex)
+	{
+		Entry entry{priority, vertex, heap.size()};
+		if(heap.size() < k)
+		{
+			heap.push_back(entry);
+			std::push_heap(heap.begin(), heap.end());
+			return entry.slot;
+		}
+		if(k > 0 && entry < heap.front())
+		{
+			std::pop_heap(heap.begin(), heap.end());
+			entry.slot  = heap.back().slot;
+			heap.back() = entry;
+			std::push_heap(heap.begin(), heap.end());
+			return entry.slot;
+		}
+		return k;
+	};
+
+	void merge(Reservoir const& other)
+	{
+		for(auto const& entry : other.heap)
+		{
+			offer(entry.priority, entry.vertex);
+		}
+	};
+
+	// Returns the sampled entries in increasing vertex order.
+	std::vector<Entry> getEntries() const
+	{
+		std::vector<Entry> result(heap);
+		std::sort(result.begin(), result.end(),
+		          [](Entry const& a, Entry const& b) {
+			          return a.vertex < b.vertex;
+		          });
+		return result;
+	};
+
+  private:
+	size_t k;
+	// max-heap of the kept entries
+	std::vector<Entry> heap;
+};
+
+// Returns the oldest minor version of the format that can describe a file :
+// 2.4 for a node table, 2.3 for quantized positions, 2.2 for compressed
+// chunks, 2.1 for aligned chunks (to store their alignment), 2.0 otherwise.
+uint32_t versionMinor(Octree::Flags flags, uint64_t chunkAlignment)
+{
+	if((flags & Octree::Flags::NODE_TABLE) != Octree::Flags::NONE)
+	{
+		return 4;
+	}
+	if((flags & Octree::Flags::QUANTIZED_POSITIONS) != Octree::Flags::NONE)
+	{
+		return 3;
+	}
+	if((flags & Octree::Flags::COMPRESSED_CHUNKS) != Octree::Flags::NONE)
+	{
+		return 2;
+	}
+	return chunkAlignment > 1 ? 1 : 0;
+}
+
+// Writes what precedes the tree structure in an octree file. negDataStart is
+// -1 times the address of the first chunk. nodeTableAddress is only written
+// if flags has NODE_TABLE.
+void writeFileHeader(std::ostream& stream, int64_t negDataStart,
+                     Octree::Flags flags, uint64_t chunkAlignment,
+                     int64_t nodeTableAddress)
+{
+	// force versioned flag
+	uint64_t flagsUint64(
+	    static_cast<uint64_t>(flags | Octree::Flags::VERSIONED));
+	brw::write(stream, negDataStart);
+	brw::write(stream, flagsUint64);
+	uint32_t versionMajor(VERSION_MAJOR);
+	uint32_t minor(versionMinor(flags, chunkAlignment));
+	brw::write(stream, versionMajor);
+	brw::write(stream, minor);
+	if(minor >= 1)
+	{
+		brw::write(stream, chunkAlignment);
+	}
+	if(minor >= 4)
+	{
+		brw::write(stream, nodeTableAddress);
+	}
+}
+
+// Returns the number of bytes written by writeFileHeader.
+int64_t fileHeaderSize(Octree::Flags flags, uint64_t chunkAlignment)
+{
+	uint32_t minor(versionMinor(flags, chunkAlignment));
+	return 2 * sizeof(int64_t) + 2 * sizeof(uint32_t)
+	       + (minor >= 1 ? sizeof(uint64_t) : 0)
+	       + (minor >= 4 ? sizeof(int64_t) : 0);
+}
+
+// Writes the node table of octree at the current position of stream (after
+// the chunks) if its flags ask for it, and returns its address (0 otherwise).
+int64_t appendNodeTable(std::ostream& stream, Octree const& octree)
+{
+	if((octree.getFlags() & Octree::Flags::NODE_TABLE) == Octree::Flags::NONE)
+	{
+		return 0;
+	}
+	int64_t address(stream.tellp());
+	octree.writeNodeTable(stream);
+	return address;
+}
+
+// Returns the number of bytes preceding the data of a chunk.
+int64_t chunkHeaderSize(Octree::Flags flags)
+{
+	if(Octree::hasChunkCodec(flags))
+	{
+		return codec::chunkHeaderSize;
+	}
+	return sizeof(uint64_t);
+}
+
+// Encodes the size floats of data as a whole chunk of a tree having flags.
+void encodeChunk(Octree::Flags flags, unsigned int dimPerVertex,
+                 float const* data, size_t size, std::vector<char>& chunk)
+{
+	const Octree::Flags quantized(Octree::Flags::NORMALIZED_NODES
+	                              | Octree::Flags::QUANTIZED_POSITIONS);
+	codec::encodeChunk(
+	    data, size, dimPerVertex,
+	    (flags & Octree::Flags::COMPRESSED_CHUNKS) != Octree::Flags::NONE,
+	    (flags & quantized) == quantized, chunk);
+}
+
+// Returns the first address from address at which a chunk can be written so
+// that its data is aligned.
+int64_t alignChunk(int64_t address, Octree::Flags flags,
+                   uint64_t chunkAlignment)
+{
+	int64_t dataAddress(address + chunkHeaderSize(flags));
+	dataAddress = (dataAddress + chunkAlignment - 1) / chunkAlignment
+	              * chunkAlignment;
+	return dataAddress - chunkHeaderSize(flags);
+}
+
+// Writes zeros to stream up to address (which it has to be before).
+void writePadding(std::ostream& stream, int64_t address)
+{
+	int64_t position(stream.tellp());
+	if(address > position)
+	{
+		std::vector<char> padding(address - position, 0);
+		stream.write(padding.data(), padding.size());
+	}
+}
+
+// Buffers 64bit ints to write them to a stream by blocks.
+class TokenWriter
+{
+  public:
+	explicit TokenWriter(std::ostream& stream)
+	    : stream(stream)
+	{
+	}
+	void put(int64_t token)
+	{
+		if(size == bufferSize)
+		{
+			flush();
+		}
+		buffer[size++] = token;
+	};
+	void flush()
+	{
+		if(size > 0)
+		{
+			brw::write(stream, buffer[0], size);
+		}
+		size = 0;
+	};
+
+  private:
+	static const size_t bufferSize = 1024;
+	std::ostream& stream;
+	int64_t buffer[bufferSize];
+	size_t size = 0;
+};
+} // namespace
+
 // std::string Octree::tabs    = "";
 // std::ofstream Octree::debug = std::ofstream("LIBOCTREE.debug");
 
-unsigned int Octree::threadsLaunched    = 0;
-std::mutex Octree::threadsLaunchedMutex = {};
-size_t Octree::verticesLoaded;
-std::mutex Octree::verticesLoadedMutex = {};
-
-size_t Octree::totalNumberOfVertices = 0;
+// Counts the vertices put in leaves during a construction and reports the
+// progress through CommonData's progressCallback. The counter is updated
+// concurrently by the construction threads without any lock. A thread only
+// reports the progress if the interval since the last report has elapsed and
+// no other thread is already reporting it.
+class ProgressCounter
+{
+  public:
+	// Sets itself as commonData's progress until destroyed.
+	ProgressCounter(Octree::CommonData& commonData, size_t verticesNumber)
+	    : commonData(commonData)
+	    , verticesNumber(verticesNumber)
+	    , interval(
+	          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	              std::chrono::duration<float>(commonData.progressInterval)))
+	{
+		commonData.progress = this;
+	};
+	ProgressCounter(ProgressCounter const& other)            = delete;
+	ProgressCounter& operator=(ProgressCounter const& other) = delete;
+	void add(size_t vertices)
+	{
+		size_t done(processed.fetch_add(vertices, std::memory_order_relaxed)
+		            + vertices);
+		if(!commonData.progressCallback)
+			return;
+
+		int64_t now(
+		    std::chrono::steady_clock::now().time_since_epoch().count());
+		int64_t next(nextReport.load(std::memory_order_relaxed));
+		if(now < next
+		   || !nextReport.compare_exchange_strong(next, now + interval.count(),
+		                                          std::memory_order_relaxed))
+			return;
+		std::unique_lock<std::mutex> lock(reporting, std::try_to_lock);
+		// the final report is left to finish()
+		if(lock.owns_lock() && done < verticesNumber)
+			commonData.progressCallback(done / (float) verticesNumber);
+	};
+	// Reports the end of the construction.
+	void finish()
+	{
+		std::lock_guard<std::mutex> lock(reporting);
+		if(commonData.progressCallback)
+			commonData.progressCallback(1.f);
+	};
+	~ProgressCounter() { commonData.progress = nullptr; };
+
+  private:
+	Octree::CommonData& commonData;
+	const size_t verticesNumber;
+	const std::chrono::steady_clock::duration interval;
+	std::atomic<size_t> processed{0};
+	// steady_clock time from which the next report can be done
+	std::atomic<int64_t> nextReport{0};
+	std::mutex reporting;
+};
+
+const size_t Octree::nodeTableEntrySize;
 
 Octree::Octree()
     : rootManagedCommonData(new CommonData)
     , commonData(*rootManagedCommonData)
 {
+	commonData.arena = new NodeArena;
 }
 
 Octree::Octree(CommonData& commonData)
@@ -42,187 +527,369 @@ Octree::Octree(CommonData& commonData)
 void Octree::setFlags(Flags flags)
 {
 	commonData.flags        = flags;
-	commonData.dimPerVertex = 3;
+	commonData.dimPerVertex = getDimPerVertex(flags);
+}
+
+bool Octree::hasChunkCodec(Flags flags)
+{
+	return (flags & (Flags::COMPRESSED_CHUNKS | Flags::QUANTIZED_POSITIONS))
+	       != Flags::NONE;
+}
+
+unsigned int Octree::getDimPerVertex(Flags flags)
+{
+	unsigned int dimPerVertex(3);
 	if((flags & Flags::STORE_RADIUS) != Flags::NONE)
-		++commonData.dimPerVertex;
+		++dimPerVertex;
 	if((flags & Flags::STORE_LUMINOSITY) != Flags::NONE)
-		++commonData.dimPerVertex;
+		++dimPerVertex;
 	if((flags & Flags::STORE_COLOR) != Flags::NONE)
-		commonData.dimPerVertex += 3;
+		dimPerVertex += 3;
 	if((flags & Flags::STORE_DENSITY) != Flags::NONE)
-		++commonData.dimPerVertex;
+		++dimPerVertex;
 	if((flags & Flags::STORE_TEMPERATURE) != Flags::NONE)
-		++commonData.dimPerVertex;
+		++dimPerVertex;
+	return dimPerVertex;
+}
+
+void Octree::setChunkAlignment(uint64_t chunkAlignment)
+{
+	if(chunkAlignment == 0 || (chunkAlignment & (chunkAlignment - 1)) != 0)
+	{
+		throw(std::string("Chunk alignment must be a power of two"));
+	}
+	commonData.chunkAlignment = chunkAlignment;
+}
+
+unsigned int Octree::getMaxLeafSizeForChunkSize(size_t chunkSize) const
+{
+	const size_t header(chunkHeaderSize(commonData.flags));
+	if(chunkSize <= header)
+	{
+		return 0;
+	}
+	size_t result((chunkSize - header)
+	              / (sizeof(float) * commonData.dimPerVertex));
+	return std::min(result, static_cast<size_t>(
+	                            std::numeric_limits<unsigned int>::max()));
 }
 
 void Octree::init(std::vector<float>& data, unsigned int maxLeafSize)
 {
-	totalNumberOfVertices = data.size() / commonData.dimPerVertex;
-	std::cout.precision(3);
-	initParallel(&data, 0, (data.size() / commonData.dimPerVertex) - 1, maxLeafSize);
-	std::cout.precision(6);
+	init(data.data(), data.size(), maxLeafSize);
 }
 
-void Octree::init(std::vector<float>& data, size_t beg, size_t end, unsigned int maxLeafSize)
+void Octree::init(float* data, size_t size, unsigned int maxLeafSize)
 {
-	size_t verticesNumber(end - beg + 1);
-	if(verticesNumber <= maxLeafSize)
+	samplingKey = mix(commonData.seed);
+	ProgressCounter progress(commonData, size / commonData.dimPerVertex);
 	{
-		this->data.setAsReference(&data, beg * commonData.dimPerVertex,
-		                          (end + 1) * commonData.dimPerVertex - 1);
+		ThreadPool pool(commonData.threadsNumber);
+		initParallel(pool, data, 0, (size / commonData.dimPerVertex) - 1,
+		             maxLeafSize);
+		pool.waitForAll();
 	}
-	else
+	progress.finish();
+}
+
+void Octree::init(float* data, size_t beg, size_t end, unsigned int maxLeafSize)
+{
+	size_t childrenBeg[8], childrenSize[8];
+	if(!initNode(data, beg, end, maxLeafSize, childrenBeg, childrenSize))
 	{
-		this->data.setAsVector();
-		this->data.asVector().reserve(maxLeafSize * commonData.dimPerVertex);
+		return;
 	}
-	totalDataSize = commonData.dimPerVertex * verticesNumber;
-	for(size_t i(beg); i <= end; ++i)
-	{
-		if(get(data, i, 0) < minX)
-			minX = get(data, i, 0);
-		if(get(data, i, 0) > maxX)
-			maxX = get(data, i, 0);
-		if(get(data, i, 1) < minY)
-			minY = get(data, i, 1);
-		if(get(data, i, 1) > maxY)
-			maxY = get(data, i, 1);
-		if(get(data, i, 2) < minZ)
-			minZ = get(data, i, 2);
-		if(get(data, i, 2) > maxZ)
-			maxZ = get(data, i, 2);
-
-		if(verticesNumber > maxLeafSize
-		   && this->data.size() < maxLeafSize * commonData.dimPerVertex
-		   && (static_cast<float>(rand()) / static_cast<float>(RAND_MAX))
-		          < maxLeafSize / (float) verticesNumber)
+	for(unsigned int i(0); i < 8; ++i)
+	{
+		if(childrenSize[i] > 0)
 		{
-			for(unsigned int j(0); j < commonData.dimPerVertex; ++j)
-			{
-				this->data.push_back(get(data, i, j));
-			}
+			createChild(i)->init(data, childrenBeg[i],
+			                     childrenBeg[i] + childrenSize[i] - 1,
+			                     maxLeafSize);
 		}
 	}
-	if((commonData.flags & Flags::NORMALIZED_NODES) != Flags::NONE)
+}
+
+void Octree::initParallel(ThreadPool& pool, float* data, size_t beg,
+                          size_t end, unsigned int maxLeafSize)
+{
+	size_t childrenBeg[8], childrenSize[8];
+	if(!initNode(data, beg, end, maxLeafSize, childrenBeg, childrenSize,
+	             &pool))
 	{
-		float localScale(1.f);
-		if((maxX - minX > maxY - minY) && (maxX - minX > maxZ - minZ))
+		return;
+	}
+
+	// Subtrees that are too small to be worth a task are constructed by this
+	// thread, once the bigger ones have been submitted to the pool.
+	const size_t minTaskSize(4 * static_cast<size_t>(maxLeafSize));
+	for(unsigned int i(0); i < 8; ++i)
+	{
+		if(childrenSize[i] <= minTaskSize)
 		{
-			localScale = maxX - minX;
+			continue;
 		}
-		else if(maxY - minY > maxZ - minZ)
+		Octree* child(createChild(i));
+		size_t childBeg(childrenBeg[i]), childEnd(childBeg + childrenSize[i] - 1);
+		pool.submit([&pool, child, data, childBeg, childEnd, maxLeafSize]() {
+			child->initParallel(pool, data, childBeg, childEnd, maxLeafSize);
+		});
+	}
+	for(unsigned int i(0); i < 8; ++i)
+	{
+		if(childrenSize[i] > 0 && childrenSize[i] <= minTaskSize)
 		{
-			localScale = maxY - minY;
+			createChild(i)->init(data, childrenBeg[i],
+			                     childrenBeg[i] + childrenSize[i] - 1,
+			                     maxLeafSize);
 		}
-		else if(maxZ != minZ)
+	}
+}
+
+void Octree::initMorton(std::vector<float>& data, unsigned int maxLeafSize)
+{
+	const unsigned int dim(commonData.dimPerVertex);
+	const size_t verticesNumber(data.size() / dim);
+	samplingKey = mix(commonData.seed);
+	ProgressCounter progress(commonData, verticesNumber);
+	{
+		ThreadPool pool(commonData.threadsNumber);
+		const size_t blocksNumber(4 * pool.getThreadsNumber());
+		const size_t blockSize((verticesNumber + blocksNumber - 1)
+		                       / blocksNumber);
+
+		// whole data bounding box, to define the grid
+		std::vector<std::array<float, 6>> blocksBBox(
+		    blocksNumber,
+		    std::array<float, 6>{{FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX,
+		                          FLT_MAX, -FLT_MAX}});
+		pool.parallelFor(blocksNumber, [&](size_t b) {
+			size_t end(std::min(verticesNumber, (b + 1) * blockSize));
+			if(b * blockSize < end)
+			{
+				kernels::boundingBox(data.data(), dim, b * blockSize, end - 1,
+				                     blocksBBox[b].data());
+			}
+		});
+		std::array<float, 6> bbox(blocksBBox[0]);
+		for(auto const& blockBBox : blocksBBox)
 		{
-			localScale = maxZ - minZ;
+			for(unsigned int j(0); j < 3; ++j)
+			{
+				bbox[2 * j]     = std::min(bbox[2 * j], blockBBox[2 * j]);
+				bbox[2 * j + 1] = std::max(bbox[2 * j + 1], blockBBox[2 * j + 1]);
+			}
 		}
 
-		for(size_t i(0); i < this->data.size(); i += commonData.dimPerVertex)
+		// compute the keys of the vertices quantized on the grid
+		const float maxCoord((1 << morton::bitsPerAxis) - 1);
+		float scale[3];
+		for(unsigned int j(0); j < 3; ++j)
+		{
+			float extent(bbox[2 * j + 1] - bbox[2 * j]);
+			scale[j] = extent > 0.f ? maxCoord / extent : 0.f;
+		}
+		std::vector<uint64_t> keys(verticesNumber);
+		std::vector<size_t> indices(verticesNumber);
+		pool.parallelFor(blocksNumber, [&](size_t b) {
+			size_t end(std::min(verticesNumber, (b + 1) * blockSize));
+			for(size_t i(b * blockSize); i < end; ++i)
+			{
+				uint32_t q[3];
+				for(unsigned int j(0); j < 3; ++j)
+				{
+					q[j] = static_cast<uint32_t>(std::min(
+					    maxCoord, (data[i * dim + j] - bbox[2 * j]) * scale[j]));
+				}
+				keys[i]    = morton::encode(q[0], q[1], q[2]);
+				indices[i] = i;
+			}
+		});
+		morton::radixSort(pool, keys, indices);
+
+		// reorder the vertices along the curve
 		{
-			this->data[i] -= minX;
-			this->data[i] /= localScale;
-			this->data[i + 1] -= minY;
-			this->data[i + 1] /= localScale;
-			this->data[i + 2] -= minZ;
-			this->data[i + 2] /= localScale;
+			std::vector<float> sorted(data.size());
+			pool.parallelFor(blocksNumber, [&](size_t b) {
+				size_t end(std::min(verticesNumber, (b + 1) * blockSize));
+				for(size_t i(b * blockSize); i < end; ++i)
+				{
+					std::copy(data.begin() + indices[i] * dim,
+					          data.begin() + (indices[i] + 1) * dim,
+					          sorted.begin() + i * dim);
+				}
+			});
+			std::vector<size_t>().swap(indices);
+			// the tree keeps references to data, so data has to be the same
+			// vector
+			data.swap(sorted);
 		}
+
+		initMortonNode(pool, data.data(), keys, 0, 0, verticesNumber - 1,
+		               maxLeafSize);
+		pool.waitForAll();
 	}
-	if(verticesNumber <= maxLeafSize)
+	progress.finish();
+}
+
+void Octree::initMortonNode(ThreadPool& pool, float* data,
+                            std::vector<uint64_t> const& keys,
+                            unsigned int level, size_t beg, size_t end,
+                            unsigned int maxLeafSize)
+{
+	// at the finest level, all the vertices share the same key and can't be
+	// split anymore
+	unsigned int leafSize(level < morton::bitsPerAxis
+	                          ? maxLeafSize
+	                          : std::numeric_limits<unsigned int>::max());
+	if(!initNodeData(data, beg, end, leafSize, &pool))
 	{
-		showProgress(1.f - beg / (float) totalNumberOfVertices);
-		// we don't need to create children
 		return;
 	}
 
-	float midX((minX + maxX) / 2.f), midY((minY + maxY) / 2.f),
-	    midZ((minZ + maxZ) / 2.f);
-
-	// To construct the subtrees we will swap elements within the vector and
-	// split it at 7 places to have 8 parts, each corresponding to a subtree.
-	// The splitting is done with this priority : x, then y, then z. For each
-	// coordinate i, midI will be used as a pivot to put each point whose i
-	// coordinate is below midI before the i split, and each point whose i
-	// coordinate is above midI after the i split. When a split is done, it is
-	// equivalent to having two vectors instead of one, but for memory sake we
-	// keep everything in one single big vector with "splits" barriers.
-	//
-	// After this part of the algorithm, the data should be structure like this
-	// :
-	//
-	// child0 - splits[0] - child1 - splits[1] - child2 - splits[2] - child3 -
-	//             z                    y                    z
-	//
-	// splits[3] - child4 - splits[4] - child5 - splits[5] - child6 - splits[6]
-	//    x                    z                    y                    z
-	//
-	// - child7
-
-	size_t splits[7];
-
-	// split along x in half
-	splits[3] = orderPivot(data, beg, end, 0, midX);
-
-	// split each half along y in quarters
-	splits[1] = orderPivot(data, beg, splits[3] - 1, 1, midY);
-	splits[5] = orderPivot(data, splits[3], end, 1, midY);
-
-	// split each quarter by z in eighths
-	splits[0] = orderPivot(data, beg, splits[1] - 1, 2, midZ);
-	splits[2] = orderPivot(data, splits[1], splits[3] - 1, 2, midZ);
-	splits[4] = orderPivot(data, splits[3], splits[5] - 1, 2, midZ);
-	splits[6] = orderPivot(data, splits[5], end, 2, midZ);
-
-	if(splits[0] < beg || splits[6] > end)
+	// Vertices are sorted by key, so each octant is a contiguous range of
+	// vertices that we find by binary search. Keys octants are ordered like
+	// the ones of partitionOctants, so child i holds octant 7 - i.
+	size_t octantsBeg[8], octantsSize[8];
+	size_t cursor(beg);
+	for(unsigned int o(0); o < 8; ++o)
 	{
-		std::cout << "ERR0" << std::endl;
-		int* foo = (int*) 0x10;
-		*foo     = 0;
+		auto notAfter = [level, o](uint64_t key) {
+			return morton::octant(key, level) <= o;
+		};
+		octantsBeg[o] = cursor;
+		cursor = std::partition_point(keys.begin() + cursor,
+		                              keys.begin() + end + 1, notAfter)
+		         - keys.begin();
+		octantsSize[o] = cursor - octantsBeg[o];
 	}
-	for(unsigned int i(0); i < 6; ++i)
+
+	const size_t minTaskSize(4 * static_cast<size_t>(maxLeafSize));
+	for(unsigned int i(0); i < 8; ++i)
 	{
-		if(splits[i] > splits[i + 1])
+		size_t childSize(octantsSize[7 - i]);
+		if(childSize == 0)
 		{
-			std::cout << "ERR1 " << i << std::endl;
-			int* foo = (int*) 0x10;
-			*foo     = 0;
+			continue;
 		}
+		Octree* child(createChild(i));
+		size_t childBeg(octantsBeg[7 - i]), childEnd(childBeg + childSize - 1);
+		if(childSize <= minTaskSize)
+		{
+			child->initMortonNode(pool, data, keys, level + 1, childBeg,
+			                      childEnd, maxLeafSize);
+			continue;
+		}
+		pool.submit([&pool, child, data, &keys, level, childBeg, childEnd,
+		             maxLeafSize]() {
+			child->initMortonNode(pool, data, keys, level + 1, childBeg,
+			                      childEnd, maxLeafSize);
+		});
 	}
+}
 
-	// Now we just assign each child its part
-	// (*) we do it from end to begin to let the child use resize to free its
-	// part of the vector (and not erase, which is less efficient)
+Octree* Octree::createChild(unsigned int i)
+{
+	// newChild() calls operator new, which allocates within allocationArena
+	NodeArena* previousArena(allocationArena);
+	allocationArena = commonData.arena;
+	try
+	{
+		children[i] = newChild();
+	}
+	catch(...)
+	{
+		allocationArena = previousArena;
+		throw;
+	}
+	allocationArena          = previousArena;
+	children[i]->samplingKey = mix(samplingKey + i + 1);
+	return children[i];
+}
 
-	if(end > splits[6])
+bool Octree::initNode(float* data, size_t beg, size_t end,
+                      unsigned int maxLeafSize, size_t childrenBeg[8],
+                      size_t childrenSize[8], ThreadPool* pool)
+{
+	if(!initNodeData(data, beg, end, maxLeafSize, pool))
 	{
-		children[0] = newChild();
-		children[0]->init(data, splits[6], end, maxLeafSize);
+		// we don't need to create children
+		return false;
 	}
-	for(unsigned int i(6); i > 0; --i)
+
+	float mid[3] = {(minX + maxX) / 2.f, (minY + maxY) / 2.f,
+	                (minZ + maxZ) / 2.f};
+	if(commonData.splitStrategy == SplitStrategy::MEDIAN)
 	{
-		if(splits[i] > splits[i - 1])
+		medianPosition(data, commonData.dimPerVertex, beg, end, mid);
+	}
+
+	// To construct the subtrees we will swap elements within the vector so
+	// that it is split in 8 contiguous parts, each corresponding to a subtree.
+	// An octant is the concatenation of three bits (x, y, z), each being set
+	// if the vertex coordinate is above or equal to the corresponding mid
+	// value. Octants are stored in increasing order, and child i holds octant
+	// 7 - i :
+	//
+	// child7 - child6 - child5 - child4 - child3 - child2 - child1 - child0
+	//  (000)    (001)    (010)    (011)    (100)    (101)    (110)    (111)
+	const size_t verticesNumber(end - beg + 1);
+	auto partition = [&](size_t octantsBeg[8], size_t octantsSize[8]) {
+		if(verticesNumber >= parallelPartitionThreshold)
 		{
-			children[7 - i] = newChild();
-			children[7 - i]->init(data, splits[i - 1], splits[i] - 1, maxLeafSize);
+			::partitionOctants(pool, data, commonData.dimPerVertex, beg, end,
+			                   mid, octantsBeg, octantsSize);
 		}
+		else
+		{
+			kernels::partitionOctants(data, commonData.dimPerVertex, beg, end,
+			                          mid, octantsBeg, octantsSize);
+		}
+	};
+	size_t octantsBeg[8], octantsSize[8];
+	partition(octantsBeg, octantsSize);
+	if(commonData.splitStrategy == SplitStrategy::MEDIAN
+	   && std::count(octantsSize, octantsSize + 8, verticesNumber) != 0)
+	{
+		// the median planes don't split anything (more than half of the
+		// vertices share the minimum on each axis), split in the middle
+		// instead
+		mid[0] = (minX + maxX) / 2.f;
+		mid[1] = (minY + maxY) / 2.f;
+		mid[2] = (minZ + maxZ) / 2.f;
+		partition(octantsBeg, octantsSize);
 	}
-	if(splits[0] > beg)
+	if(std::count(octantsSize, octantsSize + 8, verticesNumber) != 0)
 	{
-		children[7] = newChild();
-		children[7]->init(data, beg, splits[0] - 1, maxLeafSize);
+		// All the vertices are in the same octant, which is only possible if
+		// they are identical (or too close to be split in float precision).
+		// The child would be the same node again, so keep them all in a leaf
+		// instead.
+		this->data.setAsReference(data + beg * commonData.dimPerVertex,
+		                          verticesNumber * commonData.dimPerVertex);
+		normalizeOwnData();
+		if(commonData.progress != nullptr)
+			commonData.progress->add(verticesNumber);
+		return false;
 	}
-}
 
-#include <thread>
+	// Now we just assign each child its part
+	for(unsigned int i(0); i < 8; ++i)
+	{
+		childrenBeg[i]  = octantsBeg[7 - i];
+		childrenSize[i] = octantsSize[7 - i];
+	}
+	return true;
+}
 
-void Octree::initParallel(std::vector<float>* data, size_t beg, size_t end, unsigned int maxLeafSize)
+bool Octree::initNodeData(float* data, size_t beg, size_t end,
+                          unsigned int maxLeafSize, ThreadPool* pool)
 {
 	size_t verticesNumber(end - beg + 1);
 	if(verticesNumber <= maxLeafSize)
 	{
-		this->data.setAsReference(data, beg * commonData.dimPerVertex,
-		                          (end + 1) * commonData.dimPerVertex - 1);
+		this->data.setAsReference(data + beg * commonData.dimPerVertex,
+		                          verticesNumber * commonData.dimPerVertex);
 	}
 	else
 	{
@@ -230,184 +897,744 @@ void Octree::initParallel(std::vector<float>* data, size_t beg, size_t end, unsi
 		this->data.asVector().reserve(maxLeafSize * commonData.dimPerVertex);
 	}
 	totalDataSize = commonData.dimPerVertex * verticesNumber;
-	for(size_t i(beg); i <= end; ++i)
-	{
-		if(get(*data, i, 0) < minX)
-			minX = get(*data, i, 0);
-		if(get(*data, i, 0) > maxX)
-			maxX = get(*data, i, 0);
-		if(get(*data, i, 1) < minY)
-			minY = get(*data, i, 1);
-		if(get(*data, i, 1) > maxY)
-			maxY = get(*data, i, 1);
-		if(get(*data, i, 2) < minZ)
-			minZ = get(*data, i, 2);
-		if(get(*data, i, 2) > maxZ)
-			maxZ = get(*data, i, 2);
-
-		if(verticesNumber > maxLeafSize
-		   && this->data.size() < maxLeafSize * commonData.dimPerVertex
-		   && (static_cast<float>(rand()) / static_cast<float>(RAND_MAX))
-		          < maxLeafSize / (float) verticesNumber)
+
+	// Bounding box and LOD sample are computed in a single pass over blocks of
+	// vertices. Each block computes its own bounding box and sample
+	// candidates, which are merged afterwards, so that the blocks of big nodes
+	// can be processed in parallel with the same result.
+	const bool sample(verticesNumber > maxLeafSize);
+	const bool exact(commonData.samplingMode == SamplingMode::EXACT);
+	const float probability(maxLeafSize / (float) verticesNumber);
+	const size_t minBlockSize(1 << 16);
+	size_t blocksNumber(1);
+	if(pool != nullptr && verticesNumber >= 2 * minBlockSize)
+	{
+		blocksNumber = std::min(static_cast<size_t>(4 * pool->getThreadsNumber()),
+		                        verticesNumber / minBlockSize);
+	}
+	const size_t blockSize((verticesNumber + blocksNumber - 1) / blocksNumber);
+
+	std::vector<std::array<float, 6>> blocksBBox(
+	    blocksNumber,
+	    std::array<float, 6>{{minX, maxX, minY, maxY, minZ, maxZ}});
+	// exact mode candidates
+	std::vector<Reservoir> reservoirs(blocksNumber,
+	                                  Reservoir(exact ? maxLeafSize : 0));
+	// bernoulli mode candidates, the first maxLeafSize ones will be kept
+	std::vector<std::vector<size_t>> picks(blocksNumber);
+	auto processBlock = [&](size_t b) {
+		size_t blockBeg(beg + b * blockSize);
+		size_t blockEnd(std::min(end, blockBeg + blockSize - 1));
+		// sub-blocks are small enough to stay in cache between both loops
+		for(size_t subBeg(blockBeg); subBeg <= blockEnd; subBeg += 4096)
+		{
+			size_t subEnd(std::min(blockEnd, subBeg + 4095));
+			kernels::boundingBox(data, commonData.dimPerVertex, subBeg,
+			                     subEnd, blocksBBox[b].data());
+			for(size_t i(subBeg); sample && i <= subEnd; ++i)
+			{
+				uint64_t r(random(samplingKey, i - beg));
+				if(exact)
+				{
+					reservoirs[b].offer(r, i);
+				}
+				else if(picks[b].size() < maxLeafSize
+				        && toUniform(r) < probability)
+				{
+					picks[b].push_back(i);
+				}
+			}
+		}
+	};
+	if(blocksNumber > 1)
+	{
+		pool->parallelFor(blocksNumber, processBlock);
+	}
+	else
+	{
+		processBlock(0);
+	}
+
+	minX = blocksBBox[0][0];
+	maxX = blocksBBox[0][1];
+	minY = blocksBBox[0][2];
+	maxY = blocksBBox[0][3];
+	minZ = blocksBBox[0][4];
+	maxZ = blocksBBox[0][5];
+	for(auto const& bbox : blocksBBox)
+	{
+		minX = std::min(minX, bbox[0]);
+		maxX = std::max(maxX, bbox[1]);
+		minY = std::min(minY, bbox[2]);
+		maxY = std::max(maxY, bbox[3]);
+		minZ = std::min(minZ, bbox[4]);
+		maxZ = std::max(maxZ, bbox[5]);
+	}
+
+	if(sample)
+	{
+		std::vector<size_t> sampled;
+		if(exact)
+		{
+			for(size_t b(1); b < blocksNumber; ++b)
+			{
+				reservoirs[0].merge(reservoirs[b]);
+			}
+			for(auto const& entry : reservoirs[0].getEntries())
+			{
+				sampled.push_back(entry.vertex);
+			}
+		}
+		else
+		{
+			for(size_t b(0); b < blocksNumber; ++b)
+			{
+				size_t n(std::min(picks[b].size(),
+				                  maxLeafSize - sampled.size()));
+				sampled.insert(sampled.end(), picks[b].begin(),
+				               picks[b].begin() + n);
+			}
+		}
+		for(size_t i : sampled)
 		{
 			for(unsigned int j(0); j < commonData.dimPerVertex; ++j)
 			{
-				this->data.push_back(get(*data, i, j));
+				this->data.push_back(get(data, i, j));
 			}
 		}
 	}
-	if((commonData.flags & Flags::NORMALIZED_NODES) != Flags::NONE)
+	normalizeOwnData();
+	if(verticesNumber <= maxLeafSize)
 	{
-		float localScale(1.f);
-		if((maxX - minX > maxY - minY) && (maxX - minX > maxZ - minZ))
+		if(commonData.progress != nullptr)
+			commonData.progress->add(verticesNumber);
+		return false;
+	}
+	return true;
+}
+
+
+void Octree::normalizeOwnData()
+{
+	if((commonData.flags & Flags::NORMALIZED_NODES) == Flags::NONE)
+	{
+		return;
+	}
+	float localScale(1.f);
+	if((maxX - minX > maxY - minY) && (maxX - minX > maxZ - minZ))
+	{
+		localScale = maxX - minX;
+	}
+	else if(maxY - minY > maxZ - minZ)
+	{
+		localScale = maxY - minY;
+	}
+	else if(maxZ != minZ)
+	{
+		localScale = maxZ - minZ;
+	}
+
+	for(size_t i(0); i < this->data.size(); i += commonData.dimPerVertex)
+	{
+		this->data[i] -= minX;
+		this->data[i] /= localScale;
+		this->data[i + 1] -= minY;
+		this->data[i + 1] /= localScale;
+		this->data[i + 2] -= minZ;
+		this->data[i + 2] /= localScale;
+	}
+}
+
+// Temporary file of vertices used by Octree::initOutOfCore. It is written,
+// then read, sequentially. The number of vertices and their bounding box are
+// computed while writing.
+class OutOfCoreBucket
+{
+  public:
+	OutOfCoreBucket(std::string const& path, unsigned int dimPerVertex)
+	    : path(path)
+	    , dimPerVertex(dimPerVertex){};
+
+	size_t getVerticesNumber() const { return verticesNumber; };
+	float const* getBoundingBox() const { return bbox; };
+
+	// Vertices are buffered so that small appends stay cheap.
+	void append(float const* vertices, size_t n)
+	{
+		buffer.insert(buffer.end(), vertices, vertices + n * dimPerVertex);
+		if(buffer.size() >= bufferSize * dimPerVertex)
 		{
-			localScale = maxX - minX;
+			flush();
 		}
-		else if(maxY - minY > maxZ - minZ)
+	};
+
+	// Must be called once all the vertices are appended.
+	void close()
+	{
+		flush();
+		if(out.is_open())
 		{
-			localScale = maxY - minY;
+			out.close();
 		}
-		else if(maxZ != minZ)
+		std::vector<float>().swap(buffer);
+	};
+
+	// Reads at most n vertices into vertices and returns how many were
+	// read (0 once all were read).
+	size_t read(std::vector<float>& vertices, size_t n)
+	{
+		if(!in.is_open())
 		{
-			localScale = maxZ - minZ;
+			if(verticesNumber == 0)
+			{
+				return 0;
+			}
+			in.open(path, std::ios_base::in | std::ios_base::binary);
+			if(!in.is_open())
+			{
+				throw(std::string("Cannot open temporary file ") + path);
+			}
 		}
+		n = std::min(n, verticesNumber - verticesRead);
+		vertices.resize(n * dimPerVertex);
+		if(n > 0)
+		{
+			brw::read(in, vertices[0], vertices.size());
+		}
+		verticesRead += n;
+		return n;
+	};
 
-		for(size_t i(0); i < this->data.size(); i += commonData.dimPerVertex)
+	// Removes the file once all the vertices were read (the number of
+	// vertices and bounding box are kept).
+	void release()
+	{
+		if(in.is_open())
+		{
+			in.close();
+		}
+		if(out.is_open())
+		{
+			out.close();
+		}
+		std::remove(path.c_str());
+	};
+
+	~OutOfCoreBucket() { release(); };
+
+  private:
+	static const size_t bufferSize = 4096;
+
+	std::string path;
+	unsigned int dimPerVertex;
+	size_t verticesNumber = 0;
+	size_t verticesRead   = 0;
+	float bbox[6] = {FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX};
+	std::vector<float> buffer;
+	std::ofstream out;
+	std::ifstream in;
+
+	void flush()
+	{
+		if(buffer.empty())
 		{
-			this->data[i] -= minX;
-			this->data[i] /= localScale;
-			this->data[i + 1] -= minY;
-			this->data[i + 1] /= localScale;
-			this->data[i + 2] -= minZ;
-			this->data[i + 2] /= localScale;
+			return;
+		}
+		if(!out.is_open())
+		{
+			out.open(path, std::ios_base::out | std::ios_base::binary
+			                   | std::ios_base::trunc);
+			if(!out.is_open())
+			{
+				throw(std::string("Cannot open temporary file ") + path);
+			}
 		}
+		size_t n(buffer.size() / dimPerVertex);
+		kernels::boundingBox(buffer.data(), dimPerVertex, 0, n - 1, bbox);
+		brw::write(out, buffer[0], buffer.size());
+		verticesNumber += n;
+		buffer.clear();
+	};
+};
+
+void Octree::initOutOfCore(
+    std::ostream& out,
+    std::function<void(VerticesConsumer const&)> const& produceVertices,
+    unsigned int maxLeafSize, size_t memoryBudget, std::string const& tmpDir)
+{
+	const unsigned int dim(commonData.dimPerVertex);
+	// temporary files are named after this octree's address so that
+	// concurrent constructions don't collide
+	unsigned int tmpFilesNumber(0);
+	std::function<std::string()> newTmpFile = [&]() {
+		return tmpDir + "/liboctree-"
+		       + std::to_string(reinterpret_cast<uintptr_t>(this)) + "-"
+		       + std::to_string(tmpFilesNumber++) + ".tmp";
+	};
+
+	// spill all the vertices in the root's bucket
+	OutOfCoreBucket root(newTmpFile(), dim);
+	produceVertices([&root, dim](std::vector<float> const& vertices) {
+		root.append(vertices.data(), vertices.size() / dim);
+	});
+	root.close();
+
+	samplingKey = mix(commonData.seed);
+	ProgressCounter progress(commonData, root.getVerticesNumber());
+	std::string chunksPath(newTmpFile());
+	{
+		std::ofstream chunks(chunksPath, std::ios_base::out
+		                                     | std::ios_base::binary
+		                                     | std::ios_base::trunc);
+		if(!chunks.is_open())
+		{
+			throw(std::string("Cannot open temporary file ") + chunksPath);
+		}
+		ThreadPool pool(commonData.threadsNumber);
+		size_t maxInMemory(
+		    std::max(memoryBudget / (sizeof(float) * dim),
+		             static_cast<size_t>(maxLeafSize)));
+		initOutOfCoreNode(pool, chunks, root, maxLeafSize, maxInMemory,
+		                  newTmpFile);
 	}
-	if(verticesNumber <= maxLeafSize)
+
+	// Chunks addresses are relative to the chunks file, which will be copied
+	// right after the tree structure.
+	// chunks stay aligned if dataStart is
+	const uint64_t alignment(commonData.chunkAlignment);
+	const int64_t start(out.tellp());
+	int64_t dataStart(start + fileHeaderSize(commonData.flags, alignment)
+	                  + getStructureSize() * sizeof(int64_t));
+	dataStart = (dataStart + alignment - 1) / alignment * alignment;
+	shiftFileAddresses(dataStart);
+	writeFileHeader(out, -1 * dataStart, commonData.flags, alignment, 0);
+	writeStructure(out);
+	writePadding(out, dataStart);
+
+	std::ifstream chunks(chunksPath, std::ios_base::in | std::ios_base::binary);
+	out << chunks.rdbuf();
+	chunks.close();
+	std::remove(chunksPath.c_str());
+
+	int64_t nodeTableAddress(appendNodeTable(out, *this));
+	if(nodeTableAddress != 0)
 	{
-		// delete our part of the vector, we know we are at the end of the
-		// vector per (*) (check after all the orderPivot calls)
-		// data.resize(commonData.dimPerVertex * beg);
-		std::lock_guard<std::mutex> guard(verticesLoadedMutex);
-		verticesLoaded += verticesNumber;
-		showProgress(verticesLoaded / (float) totalNumberOfVertices);
-		// we don't need to create children
+		out.seekp(start);
+		writeFileHeader(out, -1 * dataStart, commonData.flags, alignment,
+		                nodeTableAddress);
+		out.seekp(0, std::ios_base::end);
+	}
+	progress.finish();
+}
+
+void Octree::initOutOfCoreNode(ThreadPool& pool, std::ostream& chunks,
+                               OutOfCoreBucket& bucket,
+                               unsigned int maxLeafSize, size_t maxInMemory,
+                               std::function<std::string()> const& newTmpFile)
+{
+	const unsigned int dim(commonData.dimPerVertex);
+	const size_t verticesNumber(bucket.getVerticesNumber());
+	std::vector<float> batch;
+
+	if(verticesNumber <= maxInMemory)
+	{
+		// the whole subtree fits in memory
+		if(verticesNumber == 0)
+		{
+			data.setAsVector();
+		}
+		else
+		{
+			bucket.read(batch, verticesNumber);
+			bucket.release();
+			initParallel(pool, batch.data(), 0, verticesNumber - 1,
+			             maxLeafSize);
+			pool.waitForAll();
+		}
+		writeData(chunks);
+		releaseData();
 		return;
 	}
 
-	float midX((minX + maxX) / 2.f), midY((minY + maxY) / 2.f),
-	    midZ((minZ + maxZ) / 2.f);
+	// Split this node by streaming its vertices into its children's buckets,
+	// as initNode would do in memory. Vertices are counted in the same order,
+	// so the sample is drawn the same way.
+	totalDataSize = dim * verticesNumber;
+	float const* bbox(bucket.getBoundingBox());
+	minX = bbox[0];
+	maxX = bbox[1];
+	minY = bbox[2];
+	maxY = bbox[3];
+	minZ = bbox[4];
+	maxZ = bbox[5];
+	float mid[3] = {(minX + maxX) / 2.f, (minY + maxY) / 2.f,
+	                (minZ + maxZ) / 2.f};
+	const size_t batchSize(std::max(static_cast<size_t>(1),
+	                                std::min(maxInMemory / 4,
+	                                         static_cast<size_t>(1) << 20)));
+
+	// see initNode for the octants definition
+	auto octant = [&mid](float const* v) {
+		return (v[0] < mid[0] ? 0 : 4) | (v[1] < mid[1] ? 0 : 2)
+		       | (v[2] < mid[2] ? 0 : 1);
+	};
+	float minCorner[3] = {minX, minY, minZ}, maxCorner[3] = {maxX, maxY, maxZ};
+	if(octant(minCorner) == octant(maxCorner))
+	{
+		// All the vertices are in the same octant, they can't be split (see
+		// initNode) : stream them in a leaf.
+		file_addr = alignChunk(chunks.tellp(), commonData.flags,
+		                       commonData.chunkAlignment);
+		writePadding(chunks, file_addr);
+		uint64_t size(dim * verticesNumber);
+		brw::write(chunks, size);
+		if(hasChunkCodec(commonData.flags))
+		{
+			// the chunk can't be encoded while streaming it
+			uint64_t header[2] = {static_cast<uint64_t>(codec::Codec::RAW),
+			                      size * sizeof(float)};
+			brw::write(chunks, header[0], 2);
+		}
+		data.setAsVector();
+		while(size_t n = bucket.read(data.asVector(), batchSize))
+		{
+			normalizeOwnData();
+			brw::write(chunks, data[0], n * dim);
+		}
+		bucket.release();
+		chunkSize = static_cast<int64_t>(chunks.tellp()) - file_addr;
+		releaseData();
+		if(commonData.progress != nullptr)
+			commonData.progress->add(verticesNumber);
+		return;
+	}
 
-	// To construct the subtrees we will swap elements within the vector and
-	// split it at 7 places to have 8 parts, each corresponding to a subtree.
-	// The splitting is done with this priority : x, then y, then z. For each
-	// coordinate i, midI will be used as a pivot to put each point whose i
-	// coordinate is below midI before the i split, and each point whose i
-	// coordinate is above midI after the i split. When a split is done, it is
-	// equivalent to having two vectors instead of one, but for memory sake we
-	// keep everything in one single big vector with "splits" barriers.
-	//
-	// After this part of the algorithm, the data should be structure like this
-	// :
-	//
-	// child0 - splits[0] - child1 - splits[1] - child2 - splits[2] - child3 -
-	//             z                    y                    z
-	//
-	// splits[3] - child4 - splits[4] - child5 - splits[5] - child6 - splits[6]
-	//    x                    z                    y                    z
-	//
-	// - child7
+	const bool exact(commonData.samplingMode == SamplingMode::EXACT);
+	const float probability(maxLeafSize / (float) verticesNumber);
+	data.setAsVector();
+	if(exact)
+	{
+		data.asVector().resize(maxLeafSize * dim);
+	}
+	Reservoir reservoir(exact ? maxLeafSize : 0);
 
-	size_t splits[7];
+	std::vector<std::unique_ptr<OutOfCoreBucket>> octants;
+	for(unsigned int o(0); o < 8; ++o)
+	{
+		octants.emplace_back(new OutOfCoreBucket(newTmpFile(), dim));
+	}
+
+	size_t counter(0);
+	while(size_t n = bucket.read(batch, batchSize))
+	{
+		for(size_t i(0); i < n; ++i, ++counter)
+		{
+			float const* v(batch.data() + i * dim);
+			uint64_t r(random(samplingKey, counter));
+			if(exact)
+			{
+				size_t slot(reservoir.offer(r, counter));
+				if(slot < maxLeafSize)
+				{
+					std::copy(v, v + dim, &data.asVector()[slot * dim]);
+				}
+			}
+			else if(data.size() < maxLeafSize * dim
+			        && toUniform(r) < probability)
+			{
+				data.asVector().insert(data.asVector().end(), v, v + dim);
+			}
+			octants[octant(v)]->append(v, 1);
+		}
+	}
+	std::vector<float>().swap(batch);
+	for(auto& octant : octants)
+	{
+		octant->close();
+	}
+	// the vertices are all in the octants now : free disk space before
+	// recursing, so that the buckets never hold much more than the vertices
+	bucket.release();
+
+	if(exact)
+	{
+		// vertices are sorted like initNodeData sorts them
+		std::vector<float> sample;
+		sample.reserve(maxLeafSize * dim);
+		for(auto const& entry : reservoir.getEntries())
+		{
+			sample.insert(sample.end(), &data[entry.slot * dim],
+			              &data[entry.slot * dim] + dim);
+		}
+		data.asVector().swap(sample);
+	}
+	normalizeOwnData();
+	writeOwnData(chunks);
+	releaseData();
+
+	for(unsigned int i(0); i < 8; ++i)
+	{
+		OutOfCoreBucket& octant(*octants[7 - i]);
+		if(octant.getVerticesNumber() > 0)
+		{
+			createChild(i)->initOutOfCoreNode(pool, chunks, octant,
+			                                  maxLeafSize, maxInMemory,
+			                                  newTmpFile);
+		}
+		// free disk space as soon as possible
+		octants[7 - i].reset();
+	}
+}
 
-	// split along x in half
-	splits[3] = orderPivot(*data, beg, end, 0, midX);
+void Octree::releaseData()
+{
+	data.setAsVector();
+	std::vector<float>().swap(data.asVector());
+	for(Octree* child : children)
+	{
+		if(child != nullptr)
+		{
+			child->releaseData();
+		}
+	}
+}
 
-	// split each half along y in quarters
-	splits[1] = orderPivot(*data, beg, splits[3] - 1, 1, midY);
-	splits[5] = orderPivot(*data, splits[3], end, 1, midY);
+void Octree::shiftFileAddresses(int64_t offset)
+{
+	file_addr += offset;
+	for(Octree* child : children)
+	{
+		if(child != nullptr)
+		{
+			child->shiftFileAddresses(offset);
+		}
+	}
+}
 
-	// split each quarter by z in eighths
-	splits[0] = orderPivot(*data, beg, splits[1] - 1, 2, midZ);
-	splits[2] = orderPivot(*data, splits[1], splits[3] - 1, 2, midZ);
-	splits[4] = orderPivot(*data, splits[3], splits[5] - 1, 2, midZ);
-	splits[6] = orderPivot(*data, splits[5], end, 2, midZ);
+void Octree::deriveSamplingKeys()
+{
+	for(unsigned int i(0); i < 8; ++i)
+	{
+		if(children[i] != nullptr)
+		{
+			children[i]->samplingKey = mix(samplingKey + i + 1);
+			children[i]->deriveSamplingKeys();
+		}
+	}
+}
+
+void Octree::append(std::iostream& file, std::vector<float>& vertices,
+                    unsigned int maxLeafSize)
+{
+	append(file, vertices.data(), vertices.size(), maxLeafSize);
+}
 
-	if(splits[0] < beg || splits[6] > end)
+void Octree::append(std::iostream& file, float* vertices, size_t size,
+                    unsigned int maxLeafSize)
+{
+	const unsigned int dim(commonData.dimPerVertex);
+	if(size < dim)
+	{
+		return;
+	}
+	if(commonData.versionMajor < 2)
 	{
-		std::cout << "ERR0" << std::endl;
-		int* foo = (int*) 0x10;
-		*foo     = 0;
+		throw(std::string("Can only append to octree files of version 2.0 "
+		                  "or more"));
 	}
-	for(unsigned int i(0); i < 6; ++i)
+	// same keys as if the tree was constructed with the current seed
+	samplingKey = mix(commonData.seed);
+	deriveSamplingKeys();
+
+	appendNode(file, vertices, 0, size / dim - 1, maxLeafSize);
+
+	// The structure has to fit between the file header and the first chunk.
+	// If it doesn't anymore, the chunks in the way are moved to the end of the
+	// file, and some room is left for the next appends.
+	const int64_t structureStart(
+	    fileHeaderSize(commonData.flags, commonData.chunkAlignment));
+	int64_t structureEnd(structureStart
+	                     + getStructureSize() * sizeof(int64_t));
+	file.seekg(0);
+	int64_t dataStart;
+	brw::read(file, dataStart);
+	dataStart *= -1;
+	if(structureEnd > dataStart)
 	{
-		if(splits[i] > splits[i + 1])
-		{
-			std::cout << "ERR1 " << i << std::endl;
-			int* foo = (int*) 0x10;
-			*foo     = 0;
-		}
+		dataStart = structureEnd + (structureEnd - structureStart) / 4;
+		dataStart = (dataStart + sizeof(int64_t) - 1) / sizeof(int64_t)
+		            * sizeof(int64_t);
+		// chunks moved to the end of the file must be after dataStart
+		file.seekp(0, std::ios_base::end);
+		writePadding(file, dataStart);
+		relocateChunks(file, dataStart);
+	}
+	// the previous node table is left unused, like the previous chunks
+	file.seekp(0, std::ios_base::end);
+	int64_t nodeTableAddress(appendNodeTable(file, *this));
+	file.seekp(0);
+	writeFileHeader(file, -1 * dataStart, commonData.flags,
+	                commonData.chunkAlignment, nodeTableAddress);
+	writeStructure(file);
+	file.flush();
+	if(!file)
+	{
+		throw(std::string("Cannot write to the octree file"));
 	}
+}
 
-	// Now we just assign each child its part
-	// (*) we do it from end to begin to let the child use resize to free its
-	// part of the vector (and not erase, which is less efficient)
+void Octree::appendNode(std::iostream& file, float* data, size_t beg,
+                        size_t end, unsigned int maxLeafSize)
+{
+	const unsigned int dim(commonData.dimPerVertex);
+	const size_t verticesNumber(end - beg + 1);
+
+	if(isLeaf())
+	{
+		// construct the leaf again from its vertices and the new ones
+		readOwnData(file);
+		std::vector<float> vertices(getOwnData());
+		releaseData();
+		vertices.insert(vertices.end(), data + beg * dim,
+		                data + (end + 1) * dim);
+		init(vertices.data(), 0, vertices.size() / dim - 1, maxLeafSize);
+		file.seekp(0, std::ios_base::end);
+		writeData(file);
+		releaseData();
+		return;
+	}
 
-	if(threadsLaunched + 8 > std::thread::hardware_concurrency())
+	// Update the sample as if the new vertices followed the previous ones
+	// (reservoir sampling) : the i-th vertex replaces a random vertex of the
+	// sample with probability maxLeafSize / i. If the previous sample was a
+	// uniform sample of maxLeafSize previous vertices (SamplingMode::EXACT),
+	// the new one is a uniform sample of all of them. A smaller sample
+	// (SamplingMode::BERNOULLI) is filled with new vertices first.
+	readOwnData(file);
+	std::vector<float> sample(getOwnData());
+	size_t counter(totalDataSize / dim);
+	for(size_t i(beg); i <= end; ++i, ++counter)
 	{
-		if(end > splits[6])
+		size_t slot(random(samplingKey, counter) % (counter + 1));
+		if(slot >= maxLeafSize)
 		{
-			children[0] = newChild();
-			children[0]->init(*data, splits[6], end, maxLeafSize);
+			continue;
 		}
-		for(unsigned int i(6); i > 0; --i)
+		if(slot * dim < sample.size())
 		{
-			if(splits[i] > splits[i - 1])
-			{
-				children[7 - i] = newChild();
-				children[7 - i]->init(*data, splits[i - 1], splits[i] - 1, maxLeafSize);
-			}
+			std::copy(data + i * dim, data + (i + 1) * dim, &sample[slot * dim]);
 		}
-		if(splits[0] > beg)
+		else
 		{
-			children[7] = newChild();
-			children[7]->init(*data, beg, splits[0] - 1, maxLeafSize);
+			sample.insert(sample.end(), data + i * dim, data + (i + 1) * dim);
 		}
 	}
-	else
+	float bbox[6] = {minX, maxX, minY, maxY, minZ, maxZ};
+	kernels::boundingBox(data, dim, beg, end, bbox);
+	minX = bbox[0];
+	maxX = bbox[1];
+	minY = bbox[2];
+	maxY = bbox[3];
+	minZ = bbox[4];
+	maxZ = bbox[5];
+	totalDataSize += dim * verticesNumber;
+	this->data.asVector().swap(sample);
+	normalizeOwnData();
+	file.seekp(0, std::ios_base::end);
+	writeOwnData(file);
+	releaseData();
+
+	// The split planes of the children aren't known anymore (they aren't
+	// the middle of the bounding box for SplitStrategy::MEDIAN or once it has
+	// been extended), so each vertex goes to the existing child whose bounding
+	// box contains it, or else the nearest one.
+	uint8_t firstChild(0);
+	while(children[firstChild] == nullptr)
 	{
-		std::thread* threads[8] = {nullptr, nullptr, nullptr, nullptr,
-		                           nullptr, nullptr, nullptr, nullptr};
-
-		if(end > splits[6])
+		++firstChild;
+	}
+	std::vector<uint8_t> targets(verticesNumber, firstChild);
+	size_t childrenSize[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	for(size_t i(0); i < verticesNumber; ++i)
+	{
+		float const* vertex(data + (beg + i) * dim);
+		float bestDistance(std::numeric_limits<float>::infinity());
+		for(unsigned int c(0); c < 8; ++c)
 		{
-			children[0] = newChild();
-			threads[0]  = new std::thread(&Octree::initParallel, children[0],
-			                              data, splits[6], end, maxLeafSize);
+			Octree const* child(children[c]);
+			if(child == nullptr)
+			{
+				continue;
+			}
+			// squared distance to the box, 0 inside
+			float d[3] = {std::max(std::max(child->minX - vertex[0],
+			                                vertex[0] - child->maxX),
+			                       0.f),
+			              std::max(std::max(child->minY - vertex[1],
+			                                vertex[1] - child->maxY),
+			                       0.f),
+			              std::max(std::max(child->minZ - vertex[2],
+			                                vertex[2] - child->maxZ),
+			                       0.f)};
+			float distance(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if(distance < bestDistance)
+			{
+				bestDistance = distance;
+				targets[i]   = c;
+			}
 		}
-		for(unsigned int i(6); i > 0; --i)
+		++childrenSize[targets[i]];
+	}
+	// in place partition of the vertices by target child
+	size_t childrenBeg[8], next[8];
+	for(unsigned int c(0); c < 8; ++c)
+	{
+		childrenBeg[c] = c == 0 ? 0 : childrenBeg[c - 1] + childrenSize[c - 1];
+		next[c]        = childrenBeg[c];
+	}
+	for(unsigned int c(0); c < 8; ++c)
+	{
+		while(next[c] < childrenBeg[c] + childrenSize[c])
 		{
-			if(splits[i] > splits[i - 1])
+			size_t i(next[c]);
+			uint8_t target(targets[i]);
+			if(target == c)
 			{
-				children[7 - i] = newChild();
-				threads[7 - i]
-				    = new std::thread(&Octree::initParallel, children[7 - i],
-				                      data, splits[i - 1], splits[i] - 1, maxLeafSize);
+				++next[c];
+				continue;
 			}
+			size_t j(next[target]++);
+			std::swap_ranges(data + (beg + i) * dim, data + (beg + i + 1) * dim,
+			                 data + (beg + j) * dim);
+			std::swap(targets[i], targets[j]);
 		}
-		if(splits[0] > beg)
+	}
+	for(unsigned int c(0); c < 8; ++c)
+	{
+		if(childrenSize[c] == 0)
 		{
-			children[7] = newChild();
-			threads[7]  = new std::thread(&Octree::initParallel, children[7],
-			                              data, beg, splits[0] - 1, maxLeafSize);
+			continue;
 		}
+		children[c]->appendNode(file, data, beg + childrenBeg[c],
+		                        beg + childrenBeg[c] + childrenSize[c] - 1,
+		                        maxLeafSize);
+	}
+}
 
-		for(unsigned int i(0); i < 8; ++i)
+void Octree::relocateChunks(std::iostream& file, int64_t maxAddress)
+{
+	if(file_addr < maxAddress)
+	{
+		readOwnData(file);
+		file.seekp(0, std::ios_base::end);
+		writeOwnData(file);
+		releaseData();
+	}
+	for(Octree* child : children)
+	{
+		if(child != nullptr)
 		{
-			if(threads[i] != nullptr)
-			{
-				threads[i]->join();
-				delete threads[i];
-			}
+			child->relocateChunks(file, maxAddress);
 		}
 	}
 }
@@ -415,6 +1642,10 @@ void Octree::initParallel(std::vector<float>* data, size_t beg, size_t end, unsi
 void Octree::init(std::istream& in)
 {
 	this->data.setAsVector();
+	// only read by the root, from the file header
+	int64_t nodeTableAddress(0);
+	// address of the chunks, where the structure ends, if known
+	int64_t structureEnd(-1);
 	brw::read(in, file_addr);
 	// debug << tabs << file_addr << std::endl;
 
@@ -422,6 +1653,7 @@ void Octree::init(std::istream& in)
 	// and we have flags to read !
 	if(file_addr < 0)
 	{
+		structureEnd            = -file_addr;
 		commonData.versionMajor = 0;
 		commonData.versionMinor = 0;
 		Flags flags_temp;
@@ -432,9 +1664,9 @@ void Octree::init(std::istream& in)
 		{
 			brw::read(in, commonData.versionMajor);
 			brw::read(in, commonData.versionMinor);
-			if(commonData.versionMajor < VERSION_MAJOR
+			if(commonData.versionMajor > VERSION_MAJOR
 			   || (commonData.versionMajor == VERSION_MAJOR
-			       && (int32_t) commonData.versionMinor < VERSION_MINOR))
+			       && commonData.versionMinor > VERSION_MINOR))
 			{
 				std::cerr << "Error: this version of liboctree can read octree "
 				             "files up to format version "
@@ -447,52 +1679,218 @@ void Octree::init(std::istream& in)
 				exit(EXIT_FAILURE);
 			}
 		}
-		std::cout << "Reading octree file version " << commonData.versionMajor
-		          << "." << commonData.versionMinor << std::endl;
+		commonData.chunkAlignment = 1;
+		if(commonData.versionMajor == 2 && commonData.versionMinor >= 1)
+		{
+			brw::read(in, commonData.chunkAlignment);
+		}
+		if(commonData.versionMajor == 2 && commonData.versionMinor >= 4
+		   && (commonData.flags & Flags::NODE_TABLE) != Flags::NONE)
+		{
+			brw::read(in, nodeTableAddress);
+		}
 		// read file_addr again with the real value this time
 		brw::read(in, file_addr);
 	}
-	init(file_addr, in);
+	if(!in)
+	{
+		throw(std::string("Unexpected end of octree file header"));
+	}
+	initStructure(in, structureEnd);
 
-	totalDataSize = 0;
-	int64_t readVal;
-	unsigned int i(0);
-	while(true)
+	if(nodeTableAddress != 0)
 	{
-		brw::read(in, readVal);
+		int64_t cursor(in.tellg());
+		readChunkSizes(in, nodeTableAddress);
+		in.seekg(cursor);
+	}
+}
+
+void Octree::initStructure(std::istream& in, int64_t structureEnd)
+{
+	// the structure is read by blocks of tokens, in one block if its end is
+	// known
+	const int64_t start(in.tellg());
+	size_t blockSize(4096);
+	if(structureEnd > start)
+	{
+		// don't trust structureEnd further than the end of the stream
+		in.seekg(0, std::ios::end);
+		int64_t streamEnd(in.tellg());
+		in.seekg(start);
+		if(std::min(structureEnd, streamEnd) > start)
+		{
+			blockSize = (std::min(structureEnd, streamEnd) - start)
+			            / sizeof(int64_t);
+			blockSize = std::max(blockSize, static_cast<size_t>(1));
+		}
+	}
+	std::vector<int64_t> tokens;
+	// tokens[pos] is the next token, tokensBefore the number of tokens read
+	// before tokens[0]
+	size_t pos(0), end(0), tokensBefore(0);
+	auto next = [&]() {
+		if(pos == end)
+		{
+			tokensBefore += end;
+			tokens.resize(blockSize);
+			in.read(reinterpret_cast<char*>(tokens.data()),
+			        blockSize * sizeof(int64_t));
+			end = in.gcount() / sizeof(int64_t);
+			pos = 0;
+			// the structure can end less than a block before the end of the
+			// stream
+			in.clear();
+			blockSize = 4096;
+			if(end == 0)
+			{
+				throw(
+				    std::string("Unexpected end of octree file structure"));
+			}
+		}
+		return tokens[pos++];
+	};
+	// the metadata following a file address in the structure (since version
+	// 2.0, the size and bounding box are in the chunk before)
+	const bool hasMetadata(commonData.versionMajor >= 2);
+	auto initNode = [&](Octree* node, int64_t file_addr) {
+		node->data.setAsVector();
+		node->file_addr = file_addr;
+		if(!hasMetadata)
+			return;
+		node->totalDataSize = static_cast<uint64_t>(next());
+		int64_t bbox[3] = {next(), next(), next()};
+		float bboxFloats[6];
+		std::memcpy(bboxFloats, bbox, sizeof(bboxFloats));
+		node->minX = bboxFloats[0];
+		node->maxX = bboxFloats[1];
+		node->minY = bboxFloats[2];
+		node->maxY = bboxFloats[3];
+		node->minZ = bboxFloats[4];
+		node->maxZ = bboxFloats[5];
+	};
+
+	// nodes in depth-first order
+	std::vector<Octree*> nodes;
+	// nodes whose closing parenthesis hasn't been read yet, with the index of
+	// their next child
+	std::vector<std::pair<Octree*, unsigned int>> open;
+	initNode(this, file_addr);
+	nodes.push_back(this);
+	open.emplace_back(this, 0);
+	while(!open.empty())
+	{
+		Octree* node(open.back().first);
+		unsigned int i(open.back().second);
+		int64_t readVal(next());
 		// debug << tabs << readVal << std::endl;
 		if(readVal == 1) //) <= own end
-			break;
-
+		{
+			open.pop_back();
+			continue;
+		}
+		if(i == 8)
+		{
+			throw(std::string(
+			    "Invalid octree file structure : more than 8 children"));
+		}
+		open.back().second = i + 1;
+		if(readVal == -1) // null node
+		{
+			continue;
+		}
+		Octree* child(node->createChild(i));
+		nodes.push_back(child);
 		if(readVal == 0) //( <= sub node
 		{
-			// tabs += '\t';
-			children[i] = newChild();
-			children[i]->init(in);
-			// tabs.pop_back();
-			totalDataSize += children[i]->totalDataSize;
+			initNode(child, next());
+			open.emplace_back(child, 0);
 		}
-		else if(readVal != -1) // null node
+		else
 		{
-			// tabs += '\t';
-			children[i] = newChild();
-			children[i]->init(readVal, in);
-			// tabs.pop_back();
-			totalDataSize += children[i]->totalDataSize;
+			initNode(child, readVal);
 		}
-		++i;
 	}
-	// update totalDataSize if no child
-	for(auto child : children)
+	// put the stream right after the structure
+	in.seekg(start + (tokensBefore + pos) * sizeof(int64_t));
+
+	if(!hasMetadata)
 	{
-		if(child == nullptr)
+		// leaves sizes are at the beginning of their chunk, read them in the
+		// file order
+		std::vector<Octree*> leaves;
+		for(Octree* node : nodes)
+		{
+			if(node->isLeaf())
+				leaves.push_back(node);
+		}
+		std::sort(leaves.begin(), leaves.end(),
+		          [](Octree const* a, Octree const* b) {
+			          return a->file_addr < b->file_addr;
+		          });
+		for(Octree* leaf : leaves)
+		{
+			in.seekg(leaf->file_addr + 6 * sizeof(float));
+			uint64_t size;
+			brw::read(in, size);
+			leaf->totalDataSize = size;
+		}
+		if(!in)
+		{
+			throw(std::string("Unexpected end of octree file chunk"));
+		}
+		in.seekg(start + (tokensBefore + pos) * sizeof(int64_t));
+	}
+	// the total data size of a node with children is the sum of its
+	// children's, whose are computed first in reverse depth-first order
+	for(auto it(nodes.rbegin()); it != nodes.rend(); ++it)
+	{
+		Octree* node(*it);
+		if(node->isLeaf())
 			continue;
-		return;
+		node->totalDataSize = 0;
+		for(Octree* child : node->children)
+		{
+			if(child != nullptr)
+				node->totalDataSize += child->totalDataSize;
+		}
+	}
+}
+
+void Octree::readChunkSizes(std::istream& in, int64_t address)
+{
+	// same order as writeNodeTable
+	std::vector<Octree*> nodes(1, this);
+	for(size_t i(0); i < nodes.size(); ++i)
+	{
+		for(Octree* child : nodes[i]->children)
+		{
+			if(child != nullptr)
+				nodes.push_back(child);
+		}
+	}
+	in.seekg(address);
+	uint64_t nodesNumber;
+	brw::read(in, nodesNumber);
+	if(!in || nodesNumber != nodes.size())
+	{
+		throw(std::string("Invalid octree file node table"));
+	}
+	std::vector<char> buffer(1024 * nodeTableEntrySize);
+	for(size_t i(0); i < nodes.size(); i += 1024)
+	{
+		size_t n(std::min(nodes.size() - i, static_cast<size_t>(1024)));
+		in.read(buffer.data(), n * nodeTableEntrySize);
+		if(!in)
+		{
+			throw(std::string("Unexpected end of octree file node table"));
+		}
+		for(size_t j(0); j < n; ++j)
+		{
+			brw::load(&buffer[j * nodeTableEntrySize + 8],
+			          nodes[i + j]->chunkSize);
+		}
 	}
-	in.seekg(file_addr);
-	uint64_t size;
-	brw::read(in, size);
-	totalDataSize = size;
 }
 
 void Octree::init(int64_t file_addr, std::istream& in)
@@ -546,55 +1944,343 @@ bool Octree::isLeaf() const
 std::vector<int64_t> Octree::getCompactData() const
 {
 	std::vector<int64_t> res;
+	res.reserve(getStructureSize());
 	if(!isLeaf())
 	{
 		res.push_back(0); // (
 	}
-	res.push_back(file_addr);
-	res.push_back(totalDataSize);
-	std::array<uint64_t, 3> bboxUint64(getBoundingBoxUint64Representation());
-	res.push_back(bboxUint64[0]);
-	res.push_back(bboxUint64[1]);
-	res.push_back(bboxUint64[2]);
+	forEachStructureToken([&res](int64_t token) { res.push_back(token); });
 	if(isLeaf())
 	{
-		return res;
+		res.pop_back();
+	}
+	return res;
+}
+
+size_t Octree::getStructureSize() const
+{
+	size_t size(0);
+	forEachStructureToken([&size](int64_t) { ++size; });
+	return size;
+}
+
+void Octree::writeStructure(std::ostream& out) const
+{
+	TokenWriter writer(out);
+	forEachStructureToken([&writer](int64_t token) { writer.put(token); });
+	writer.flush();
+}
+
+void Octree::writeNodeTable(std::ostream& out) const
+{
+	// breadth-first order : the children of a node are contiguous
+	std::vector<Octree const*> nodes(1, this);
+	for(size_t i(0); i < nodes.size(); ++i)
+	{
+		for(Octree const* child : nodes[i]->children)
+		{
+			if(child != nullptr)
+				nodes.push_back(child);
+		}
+	}
+	if(nodes.size() >= UINT32_MAX)
+	{
+		throw(std::string("Too many nodes for a node table"));
 	}
 
-	// compute nb of children to write (if last ones are nullptr, no need to
-	// write them)
-	unsigned int nb(8);
-	while(nb > 0 && children[nb - 1] == nullptr)
-		nb--;
-	// append compact data of children
-	for(unsigned int i(0); i < nb; ++i)
+	uint64_t nodesNumber(nodes.size());
+	brw::write(out, nodesNumber);
+	// entries are buffered and written by blocks
+	const size_t bufferSize(1024 * nodeTableEntrySize);
+	std::vector<char> buffer;
+	buffer.reserve(bufferSize);
+	uint32_t firstChild(1);
+	for(Octree const* node : nodes)
 	{
-		if(children[i] != nullptr)
+		uint32_t childMask(0);
+		for(unsigned int c(0); c < 8; ++c)
+		{
+			if(node->children[c] != nullptr)
+				childMask |= 1 << c;
+		}
+		uint64_t totalDataSize(node->totalDataSize);
+		float bbox[6] = {node->minX, node->maxX, node->minY,
+		                 node->maxY, node->minZ, node->maxZ};
+		char entry[nodeTableEntrySize];
+		brw::store(entry, node->file_addr);
+		brw::store(entry + 8, node->chunkSize);
+		brw::store(entry + 16, totalDataSize);
+		for(unsigned int k(0); k < 6; ++k)
+			brw::store(entry + 24 + 4 * k, bbox[k]);
+		brw::store(entry + 48, firstChild);
+		brw::store(entry + 52, childMask);
+		buffer.insert(buffer.end(), entry, entry + nodeTableEntrySize);
+		if(buffer.size() == bufferSize)
+		{
+			out.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+		firstChild += std::bitset<8>(childMask).count();
+	}
+	out.write(buffer.data(), buffer.size());
+}
+
+template <typename Callback>
+void Octree::forEachStructureToken(Callback const& token) const
+{
+	auto fields = [&token](Octree const& node) {
+		token(node.file_addr);
+		token(node.totalDataSize);
+		std::array<uint64_t, 3> bboxUint64(
+		    node.getBoundingBoxUint64Representation());
+		token(bboxUint64[0]);
+		token(bboxUint64[1]);
+		token(bboxUint64[2]);
+	};
+
+	fields(*this);
+	if(isLeaf())
+	{
+		token(1); // )
+		return;
+	}
+	// non-leaf nodes being written and their next child to write
+	std::vector<std::pair<Octree const*, unsigned int>> stack;
+	stack.emplace_back(this, 0);
+	while(!stack.empty())
+	{
+		Octree const* node(stack.back().first);
+		// if last children are nullptr, no need to write them
+		unsigned int nb(8);
+		while(nb > 0 && node->children[nb - 1] == nullptr)
+			nb--;
+		if(stack.back().second == nb)
+		{
+			token(1); // )
+			stack.pop_back();
+			continue;
+		}
+		Octree const* child(node->children[stack.back().second++]);
+		if(child == nullptr)
+		{
+			token(-1); // null node
+		}
+		else if(child->isLeaf())
 		{
-			for(int64_t d : children[i]->getCompactData())
-				res.push_back(d);
+			fields(*child);
 		}
 		else
 		{
-			res.push_back(-1); // null node
+			token(0); // (
+			fields(*child);
+			stack.emplace_back(child, 0);
 		}
 	}
-	res.push_back(1); // )
-	return res;
 }
 
 void Octree::writeData(std::ostream& out)
 {
-	file_addr = out.tellp();
-	uint64_t size(data.size());
-	brw::write(out, size);
-	brw::write(out, data[0], data.size());
+	if(commonData.chunkOrder == ChunkOrder::BREADTH_FIRST)
+	{
+		for(Octree* node : getNodesInChunkOrder())
+			node->writeOwnData(out);
+		return;
+	}
+	writeOwnData(out);
 
 	for(unsigned int i(0); i < 8; ++i)
 		if(children[i] != nullptr)
 			children[i]->writeData(out);
 }
 
+std::vector<Octree*> Octree::getNodesInChunkOrder()
+{
+	std::vector<Octree*> nodes;
+	if(commonData.chunkOrder == ChunkOrder::BREADTH_FIRST)
+	{
+		nodes.push_back(this);
+		for(size_t i(0); i < nodes.size(); ++i)
+		{
+			for(Octree* child : nodes[i]->children)
+			{
+				if(child != nullptr)
+					nodes.push_back(child);
+			}
+		}
+		return nodes;
+	}
+	std::vector<Octree*> stack(1, this);
+	while(!stack.empty())
+	{
+		Octree* node(stack.back());
+		stack.pop_back();
+		nodes.push_back(node);
+		for(unsigned int i(8); i > 0; --i)
+		{
+			if(node->children[i - 1] != nullptr)
+			{
+				stack.push_back(node->children[i - 1]);
+			}
+		}
+	}
+	return nodes;
+}
+
+void Octree::writeData(std::string const& path, int64_t dataStart)
+{
+#ifndef _WIN32
+	// chunks would need to be byte swapped
+	const bool positionalWrites(brw::isLittleEndian());
+#else
+	const bool positionalWrites(false);
+#endif
+	if(!positionalWrites)
+	{
+		std::fstream out(path, std::ios_base::in | std::ios_base::out
+		                           | std::ios_base::binary);
+		out.seekp(dataStart);
+		writeData(out);
+		if(!out)
+		{
+			throw(std::string("Cannot write to ") + path);
+		}
+		return;
+	}
+
+#ifndef _WIN32
+	// same order as writeData(std::ostream&)
+	std::vector<Octree*> nodes(getNodesInChunkOrder());
+
+	ThreadPool pool(commonData.threadsNumber);
+	const bool hasCodec(hasChunkCodec(commonData.flags));
+	auto encode = [this](Octree* node, std::vector<char>& chunk) {
+		encodeChunk(commonData.flags, commonData.dimPerVertex,
+		            node->data.size() > 0 ? &node->data[0] : nullptr,
+		            node->data.size(), chunk);
+	};
+	// encoded chunks are encoded once to know their size, and once again to
+	// be written, rather than being all held in memory
+	std::vector<int64_t> chunksSize(nodes.size());
+	forEachBlock(&pool, (nodes.size() + 63) / 64, [&](size_t b) {
+		std::vector<char> chunk;
+		for(size_t i(64 * b); i < std::min(nodes.size(), 64 * b + 64); ++i)
+		{
+			if(hasCodec)
+			{
+				encode(nodes[i], chunk);
+				chunksSize[i] = chunk.size();
+			}
+			else
+			{
+				chunksSize[i] = sizeof(uint64_t)
+				                + nodes[i]->data.size() * sizeof(float);
+			}
+		}
+	});
+	int64_t dataEnd(dataStart);
+	for(size_t i(0); i < nodes.size(); ++i)
+	{
+		dataEnd = alignChunk(dataEnd, commonData.flags,
+		                     commonData.chunkAlignment);
+		nodes[i]->file_addr = dataEnd;
+		nodes[i]->chunkSize = chunksSize[i];
+		dataEnd += chunksSize[i];
+	}
+
+	int fd(open(path.c_str(), O_WRONLY | O_CREAT, 0644));
+	if(fd < 0)
+	{
+		throw(std::string("Cannot open ") + path + " : "
+		      + std::strerror(errno));
+	}
+	// batches of consecutive chunks of at least batchSize bytes (but the last
+	// one), each written by a single call
+	const int64_t batchSize(1 << 22);
+	std::vector<size_t> batchesBeg;
+	for(size_t i(0); i < nodes.size(); ++i)
+	{
+		if(batchesBeg.empty()
+		   || nodes[i]->file_addr - nodes[batchesBeg.back()]->file_addr
+		          >= batchSize)
+		{
+			batchesBeg.push_back(i);
+		}
+	}
+	batchesBeg.push_back(nodes.size());
+
+	std::atomic<int> error(0);
+	auto writeBatch = [&](size_t b) {
+		size_t first(batchesBeg[b]), last(batchesBeg[b + 1]);
+		// the padding before a chunk is written with it
+		int64_t batchBeg(b == 0 ? dataStart : nodes[first]->file_addr);
+		int64_t batchEnd(last < nodes.size() ? nodes[last]->file_addr
+		                                     : dataEnd);
+		std::vector<char> buffer(batchEnd - batchBeg), encoded;
+		for(size_t i(first); i < last; ++i)
+		{
+			char* chunk(buffer.data() + (nodes[i]->file_addr - batchBeg));
+			if(hasCodec)
+			{
+				encode(nodes[i], encoded);
+				std::memcpy(chunk, encoded.data(), encoded.size());
+				continue;
+			}
+			uint64_t size(nodes[i]->data.size());
+			std::memcpy(chunk, &size, sizeof(size));
+			if(size > 0)
+			{
+				std::memcpy(chunk + sizeof(size), &nodes[i]->data[0],
+				            size * sizeof(float));
+			}
+		}
+		size_t written(0);
+		while(written < buffer.size() && error == 0)
+		{
+			ssize_t n(pwrite(fd, buffer.data() + written,
+			                 buffer.size() - written, batchBeg + written));
+			if(n < 0 && errno != EINTR)
+			{
+				error = errno;
+			}
+			else if(n > 0)
+			{
+				written += n;
+			}
+		}
+	};
+	forEachBlock(&pool, batchesBeg.size() - 1, writeBatch);
+	if(close(fd) != 0 && error == 0)
+	{
+		error = errno;
+	}
+	if(error != 0)
+	{
+		throw(std::string("Cannot write to ") + path + " : "
+		      + std::strerror(error));
+	}
+#endif
+}
+
+void Octree::writeOwnData(std::ostream& out)
+{
+	file_addr = alignChunk(out.tellp(), commonData.flags,
+	                       commonData.chunkAlignment);
+	writePadding(out, file_addr);
+	if(hasChunkCodec(commonData.flags))
+	{
+		std::vector<char> chunk;
+		encodeChunk(commonData.flags, commonData.dimPerVertex,
+		            data.size() > 0 ? &data[0] : nullptr, data.size(), chunk);
+		out.write(chunk.data(), chunk.size());
+		chunkSize = chunk.size();
+		return;
+	}
+	uint64_t size(data.size());
+	brw::write(out, size);
+	brw::write(out, data[0], data.size());
+	chunkSize = sizeof(size) + size * sizeof(float);
+}
+
 void Octree::readData(std::istream& in)
 {
 	readOwnData(in);
@@ -629,6 +2315,11 @@ void Octree::readOwnData1_0(std::istream& in)
 void Octree::readOwnData2_0(std::istream& in)
 {
 	in.seekg(file_addr);
+	if(hasChunkCodec(commonData.flags))
+	{
+		codec::readChunk(in, commonData.dimPerVertex, data.asVector());
+		return;
+	}
 	uint64_t size;
 	brw::read(in, size);
 	data.asVector().resize(size);
@@ -775,6 +2466,34 @@ Octree::~Octree()
 		if(t != nullptr)
 			delete t;
 	}
+	if(rootManagedCommonData != nullptr)
+	{
+		// all the nodes have been destroyed, free their memory at once
+		delete rootManagedCommonData->arena;
+		delete rootManagedCommonData;
+	}
+}
+
+void* Octree::operator new(size_t size)
+{
+	// each node is preceded by the arena it was allocated in (nullptr if it
+	// was allocated on the heap) so that operator delete knows what to do
+	const size_t prefix(NodeArena::alignment);
+	char* p(static_cast<char*>(
+	    allocationArena != nullptr ? allocationArena->allocate(prefix + size)
+	                               : ::operator new(prefix + size)));
+	*reinterpret_cast<NodeArena**>(p) = allocationArena;
+	return p + prefix;
+}
+
+void Octree::operator delete(void* ptr)
+{
+	if(ptr == nullptr)
+		return;
+	char* p(static_cast<char*>(ptr) - NodeArena::alignment);
+	// nodes within an arena are freed with it
+	if(*reinterpret_cast<NodeArena**>(p) == nullptr)
+		::operator delete(p);
 }
 
 void write(std::ostream& stream, Octree& octree)
@@ -783,66 +2502,63 @@ void write(std::ostream& stream, Octree& octree)
 
 	// write flags
 	int64_t minusone(-1);
-	// force versioned flag
-	uint64_t flags(
-	    static_cast<uint64_t>(octree.getFlags() | Octree::Flags::VERSIONED));
-	brw::write(stream, minusone);
-	brw::write(stream, flags);
-	uint32_t versionMajor(VERSION_MAJOR);
-	uint32_t versionMinor(VERSION_MINOR);
-	brw::write(stream, versionMajor);
-	brw::write(stream, versionMinor);
+	writeFileHeader(stream, minusone, octree.getFlags(),
+	                octree.getChunkAlignment(), 0);
 
 	// write the rest of the tree
-	uint64_t headerSize(octree.getCompactData().size());
-	// if root is a leaf, surround it with parenthesis
-	if(headerSize == 5)
-		headerSize += 2;
+	size_t headerSize(octree.getStructureSize());
 
 	int64_t headerStart(stream.tellp());
 
 	// write zeros to leave space, don't write first '('
-	int64_t zero(0);
-	for(size_t i(1); i < headerSize; ++i)
-		brw::write(stream, zero);
+	TokenWriter zeros(stream);
+	for(size_t i(0); i < headerSize; ++i)
+		zeros.put(0);
+	zeros.flush();
 
 	int64_t negDataStart(-1 * stream.tellp());
 	// write chunks and hold their addresses
 	octree.writeData(stream);
 
+	int64_t nodeTableAddress(appendNodeTable(stream, octree));
+
 	// replace the initial -1 by -1*dataStart
 	stream.seekp(start);
-	brw::write(stream, negDataStart);
+	writeFileHeader(stream, negDataStart, octree.getFlags(),
+	                octree.getChunkAlignment(), nodeTableAddress);
 
 	// write real compact data (with true addresses)
 	stream.seekp(headerStart);
-	// we don't want to write the vector's size and the first '('
-	// so we write manually from the second element
-	std::vector<int64_t> header(octree.getCompactData());
-	if(header.size() == 5)
-	{
-		// write(stream, header) would write header size
-		brw::write(stream, header[0]);
-		brw::write(stream, header[1]);
-		brw::write(stream, header[2]);
-		brw::write(stream, header[3]);
-		brw::write(stream, header[4]);
-		int64_t closingParenthesis(1);
-		brw::write(stream, closingParenthesis);
-	}
-	else
+	octree.writeStructure(stream);
+}
+
+void write(std::string const& path, Octree& octree)
+{
 	{
-		/*std::ofstream debug("LIBOCTREE.debug");
-		std::string tabs = "";
-		for(size_t i(0); i < header.size(); ++i)
+		std::ofstream stream(path, std::ios_base::out | std::ios_base::binary
+		                               | std::ios_base::trunc);
+		if(!stream.is_open())
 		{
-		    if(header[i] == 1)
-		        tabs.pop_back();
-		    debug << tabs << header[i] << std::endl;
-		    if(header[i] == 0)
-		        tabs += '\t';
-		}*/
-		brw::write(stream, header[1], headerSize - 1);
+			throw(std::string("Cannot open ") + path);
+		}
+	}
+	int64_t dataStart(fileHeaderSize(octree.getFlags(),
+	                                 octree.getChunkAlignment())
+	                  + octree.getStructureSize() * sizeof(int64_t));
+	octree.writeData(path, dataStart);
+
+	// chunks addresses are known now
+	std::fstream stream(path, std::ios_base::in | std::ios_base::out
+	                              | std::ios_base::binary);
+	stream.seekp(0, std::ios_base::end);
+	int64_t nodeTableAddress(appendNodeTable(stream, octree));
+	stream.seekp(0);
+	writeFileHeader(stream, -1 * dataStart, octree.getFlags(),
+	                octree.getChunkAlignment(), nodeTableAddress);
+	octree.writeStructure(stream);
+	if(!stream)
+	{
+		throw(std::string("Cannot write to ") + path);
 	}
 }
 
@@ -883,70 +2599,11 @@ std::array<uint64_t, 3> Octree::getBoundingBoxUint64Representation() const
 	return result;
 }
 
-inline float Octree::get(std::vector<float> const& data, size_t vertex,
-                         unsigned int dim)
+inline float Octree::get(float const* data, size_t vertex, unsigned int dim)
 {
 	return data[commonData.dimPerVertex * vertex + dim];
 }
 
-inline void Octree::set(std::vector<float>& data, size_t vertex,
-                        unsigned int dim, float val)
-{
-	data[commonData.dimPerVertex * vertex + dim] = val;
-}
-
-void Octree::swap(std::vector<float>& data, size_t i, size_t j)
-{
-	std::vector<float> v(commonData.dimPerVertex);
-
-	for(unsigned int k(0); k < commonData.dimPerVertex; ++k)
-	{
-		float tmp = get(data, i, k);
-		set(data, i, k, get(data, j, k));
-		set(data, j, k, tmp);
-	}
-}
-
-size_t Octree::orderPivot(std::vector<float>& data, size_t beg, size_t end,
-                          unsigned int dim, float pivot)
-{
-	// check if -1 has been passed as end (split[i]-1 if split[i] == 0)
-	size_t max(0);
-	--max;
-	if(end == max)
-	{
-		return beg;
-	}
-
-	// if end == beg - 1, this is not too bad, so let it go
-	if(beg != 0 && end < (beg - 1))
-	{
-		std::cout << "\r\nCONSISTENCY ERROR : " << beg << " " << end
-		          << std::endl;
-		exit(1);
-	}
-	if(beg == end)
-		return beg;
-
-	size_t begBAK(beg), endBAK(end);
-	while(beg < end)
-	{
-		if(get(data, beg, dim) >= pivot && get(data, end, dim) < pivot)
-			swap(data, beg, end);
-		if(get(data, beg, dim) < pivot)
-			++beg;
-		if(get(data, end, dim) >= pivot)
-			--end;
-	}
-	size_t split = beg;
-	while(get(data, split, dim) > pivot && beg != begBAK)
-		--split;
-	while(get(data, split, dim) < pivot && end != endBAK)
-		++split;
-
-	return split;
-}
-
 void Octree::showProgress(float progress)
 {
 	if(progress > 1.f || progress < 0.f)
@@ -0,0 +1,207 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "OctreeFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "codec.hpp"
+
+void OctreeFile::open(std::string const& path)
+{
+	close();
+	std::ifstream in(path, std::ios_base::binary);
+	if(!in.is_open())
+		throw(std::string("Can't open octree file ") + path);
+#ifndef _WIN32
+	int fd(::open(path.c_str(), O_RDONLY));
+	struct stat status;
+	if(fd < 0 || fstat(fd, &status) != 0 || status.st_size == 0)
+	{
+		if(fd >= 0)
+			::close(fd);
+		throw(std::string("Can't map octree file ") + path);
+	}
+	void* addr(
+	    mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0));
+	// the mapping stays valid without the file descriptor
+	::close(fd);
+	if(addr == MAP_FAILED)
+		throw(std::string("Can't map octree file ") + path);
+	mapping     = static_cast<char const*>(addr);
+	mappingSize = status.st_size;
+#else
+	in.seekg(0, std::ios_base::end);
+	content.resize(in.tellg());
+	in.seekg(0);
+	in.read(content.data(), content.size());
+	if(!in || content.empty())
+	{
+		close();
+		throw(std::string("Can't read octree file ") + path);
+	}
+	mapping     = content.data();
+	mappingSize = content.size();
+	in.seekg(0);
+#endif
+	try
+	{
+		tree.init(in);
+	}
+	catch(...)
+	{
+		close();
+		throw;
+	}
+}
+
+void OctreeFile::close()
+{
+#ifndef _WIN32
+	if(mapping != nullptr)
+		munmap(const_cast<char*>(mapping), mappingSize);
+#endif
+	mapping     = nullptr;
+	mappingSize = 0;
+	content     = std::vector<char>();
+	tree        = LinearOctree();
+}
+
+bool OctreeFile::isZeroCopy() const
+{
+	return !Octree::hasChunkCodec(tree.getFlags());
+}
+
+OctreeFile::Span OctreeFile::getData(Index node,
+                                     std::vector<float>& buffer) const
+{
+	const size_t offset(getChunkOffset(node));
+	char const* chunk(mapping + offset);
+	const size_t available(mappingSize - offset);
+	if(!isZeroCopy())
+	{
+		codec::decodeChunk(chunk, available, tree.getDimPerVertex(), buffer);
+		return {buffer.data(), buffer.size()};
+	}
+
+	uint64_t size;
+	if(available < sizeof(size))
+		throw(std::string("Unexpected end of octree file chunk"));
+	std::memcpy(&size, chunk, sizeof(size));
+	if(size > (available - sizeof(size)) / sizeof(float))
+		throw(std::string("Unexpected end of octree file chunk"));
+	char const* floats(chunk + sizeof(size));
+	// the mapping is page aligned, so only hand-made files can have
+	// misaligned chunks
+	if(reinterpret_cast<uintptr_t>(floats) % alignof(float) == 0)
+		return {reinterpret_cast<float const*>(floats), size};
+	buffer.resize(size);
+	if(size > 0)
+		std::memcpy(buffer.data(), floats, size * sizeof(float));
+	return {buffer.data(), buffer.size()};
+}
+
+void OctreeFile::advise(Advice advice) const
+{
+	advise(0, mappingSize, advice);
+}
+
+void OctreeFile::advise(Index node, Advice advice) const
+{
+	advise(getChunkOffset(node), getChunkSize(node), advice);
+}
+
+OctreeFile::~OctreeFile()
+{
+	close();
+}
+
+size_t OctreeFile::getChunkOffset(Index node) const
+{
+	if(node >= tree.size())
+		throw(std::string("Invalid octree node index"));
+	int64_t file_addr(tree[node].file_addr);
+	// version 1.0 chunks begin with the bounding box
+	if(tree.getVersionMajor() < 2)
+		file_addr += 6 * sizeof(float);
+	if(file_addr < 0 || static_cast<uint64_t>(file_addr) >= mappingSize)
+		throw(std::string("Invalid octree file chunk address"));
+	return file_addr;
+}
+
+size_t OctreeFile::getChunkSize(Index node) const
+{
+	const size_t offset(getChunkOffset(node));
+	const size_t available(mappingSize - offset);
+	if(tree[node].chunkSize != 0)
+		return std::min<uint64_t>(tree[node].chunkSize, available);
+	// read the size from the chunk header
+	uint64_t header[3] = {0, 0, 0};
+	std::memcpy(header, mapping + offset,
+	            std::min(available, codec::chunkHeaderSize));
+	uint64_t size(sizeof(uint64_t) + header[0] * sizeof(float));
+	if(!isZeroCopy())
+		size = codec::chunkHeaderSize + header[2];
+	return std::min<uint64_t>(size, available);
+}
+
+void OctreeFile::advise(size_t offset, size_t size, Advice advice) const
+{
+#ifndef _WIN32
+	if(mapping == nullptr || size == 0)
+		return;
+	int madvice(MADV_NORMAL);
+	switch(advice)
+	{
+		case Advice::NORMAL:
+			madvice = MADV_NORMAL;
+			break;
+		case Advice::SEQUENTIAL:
+			madvice = MADV_SEQUENTIAL;
+			break;
+		case Advice::RANDOM:
+			madvice = MADV_RANDOM;
+			break;
+		case Advice::WILLNEED:
+			madvice = MADV_WILLNEED;
+			break;
+		case Advice::DONTNEED:
+			madvice = MADV_DONTNEED;
+			break;
+	}
+	// madvise needs a page aligned address
+	const size_t pageSize(sysconf(_SC_PAGESIZE));
+	const size_t begin(offset / pageSize * pageSize);
+	const size_t end(std::min(offset + size, mappingSize));
+	// only a hint, failures can be ignored
+	madvise(const_cast<char*>(mapping) + begin, end - begin, madvice);
+#else
+	(void) offset;
+	(void) size;
+	(void) advice;
+#endif
+}
@@ -0,0 +1,186 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "ThreadPool.hpp"
+
+thread_local ThreadPool* ThreadPool::currentPool    = nullptr;
+thread_local unsigned int ThreadPool::currentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned int threadsNumber)
+    : pendingTasks(0)
+    , queuedTasks(0)
+    , nextQueue(0)
+{
+	if(threadsNumber == 0)
+		threadsNumber = std::thread::hardware_concurrency();
+	// hardware_concurrency can return 0 if it is not computable
+	if(threadsNumber == 0)
+		threadsNumber = 1;
+
+	for(unsigned int i(0); i < threadsNumber; ++i)
+		queues.emplace_back(new Queue);
+	for(unsigned int i(0); i < threadsNumber; ++i)
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	unsigned int queue;
+	if(currentPool == this)
+		queue = currentWorker;
+	else
+		queue = nextQueue.fetch_add(1) % queues.size();
+
+	++pendingTasks;
+	{
+		// lock so that a worker can't miss the notification between its
+		// check of queuedTasks and its wait
+		std::lock_guard<std::mutex> guard(sleepMutex);
+		++queuedTasks;
+	}
+	{
+		std::lock_guard<std::mutex> guard(queues[queue]->mutex);
+		queues[queue]->tasks.push_back(std::move(task));
+	}
+	workAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t tasksNumber,
+                             std::function<void(size_t)> const& task)
+{
+	if(tasksNumber == 0)
+		return;
+
+	struct Group
+	{
+		std::atomic<size_t> remaining;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	std::shared_ptr<Group> group(std::make_shared<Group>());
+	group->remaining = tasksNumber;
+
+	for(size_t i(0); i < tasksNumber; ++i)
+	{
+		submit([group, &task, i]() {
+			task(i);
+			if(--group->remaining == 0)
+			{
+				std::lock_guard<std::mutex> guard(group->mutex);
+				group->done.notify_all();
+			}
+		});
+	}
+
+	if(currentPool == this)
+	{
+		// a waiting worker would be a lost thread (or a deadlock if all
+		// workers wait), so help instead
+		std::function<void()> other;
+		while(group->remaining > 0)
+		{
+			if(popOrSteal(currentWorker, other))
+				run(other);
+			else
+				std::this_thread::yield();
+		}
+		return;
+	}
+	std::unique_lock<std::mutex> lock(group->mutex);
+	group->done.wait(lock, [&group]() { return group->remaining == 0; });
+}
+
+void ThreadPool::waitForAll()
+{
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	allDone.wait(lock, [this]() { return pendingTasks == 0; });
+}
+
+ThreadPool::~ThreadPool()
+{
+	waitForAll();
+	{
+		std::lock_guard<std::mutex> guard(sleepMutex);
+		stop = true;
+	}
+	workAvailable.notify_all();
+	for(auto& thread : threads)
+		thread.join();
+}
+
+bool ThreadPool::popOrSteal(unsigned int worker, std::function<void()>& task)
+{
+	// own queue first, newest task
+	{
+		Queue& own(*queues[worker]);
+		std::lock_guard<std::mutex> guard(own.mutex);
+		if(!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--queuedTasks;
+			return true;
+		}
+	}
+	// then steal the oldest task of the others
+	for(unsigned int i(1); i < queues.size(); ++i)
+	{
+		Queue& victim(*queues[(worker + i) % queues.size()]);
+		std::lock_guard<std::mutex> guard(victim.mutex);
+		if(!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--queuedTasks;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(std::function<void()>& task)
+{
+	task();
+	task = nullptr;
+	if(--pendingTasks == 0)
+	{
+		std::lock_guard<std::mutex> guard(sleepMutex);
+		allDone.notify_all();
+	}
+}
+
+void ThreadPool::workerLoop(unsigned int worker)
+{
+	currentPool   = this;
+	currentWorker = worker;
+
+	std::function<void()> task;
+	while(true)
+	{
+		if(popOrSteal(worker, task))
+		{
+			run(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		workAvailable.wait(lock,
+		                   [this]() { return stop || queuedTasks > 0; });
+		if(stop && queuedTasks == 0)
+			return;
+	}
+}
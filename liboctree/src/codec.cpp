@@ -0,0 +1,468 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include "binaryrw.hpp"
+#include "kernels.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// Swaps the off-diagonal j x j blocks of the 2j x 2j sub-matrices of the
+// 32x32 bits matrix m (see transpose32x32).
+template <unsigned int j>
+inline void swapBlocks(uint32_t m[32], uint32_t mask)
+{
+	for(unsigned int base(0); base < 32; base += 2 * j)
+	{
+		// contiguous rows, which the compiler vectorizes
+		for(unsigned int k(base); k < base + j; ++k)
+		{
+			uint32_t t((m[k] >> j ^ m[k + j]) & mask);
+			m[k + j] ^= t;
+			m[k] ^= t << j;
+		}
+	}
+}
+
+// Transposes the 32x32 bits matrix whose row i is m[i] : bit j of m[i]
+// becomes bit i of m[j] (it is its own inverse).
+inline void transpose32x32(uint32_t m[32])
+{
+	swapBlocks<16>(m, 0x0000FFFF);
+	swapBlocks<8>(m, 0x00FF00FF);
+	swapBlocks<4>(m, 0x0F0F0F0F);
+	swapBlocks<2>(m, 0x33333333);
+	swapBlocks<1>(m, 0x55555555);
+}
+
+// Byte k of a row of the transposed matrix is the byte of group k in its plane,
+// which is its lowest byte whatever the host byte order.
+inline uint32_t planeOrder(uint32_t x)
+{
+	if(brw::isLittleEndian())
+		return x;
+	return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+#ifdef __SSE2__
+// Same as swapBlocks for the 4 matrices held by the lanes of m.
+template <int j>
+inline void swapBlocks(__m128i m[32], uint32_t mask)
+{
+	const __m128i vmask(_mm_set1_epi32(mask));
+	for(unsigned int base(0); base < 32; base += 2 * j)
+	{
+		for(unsigned int k(base); k < base + j; ++k)
+		{
+			__m128i t(_mm_and_si128(
+			    _mm_xor_si128(_mm_srli_epi32(m[k], j), m[k + j]), vmask));
+			m[k + j] = _mm_xor_si128(m[k + j], t);
+			m[k]     = _mm_xor_si128(m[k], _mm_slli_epi32(t, j));
+		}
+	}
+}
+
+// Transposes the 4 32x32 bits matrices held by the lanes of m at once.
+inline void transpose32x32(__m128i m[32])
+{
+	swapBlocks<16>(m, 0x0000FFFF);
+	swapBlocks<8>(m, 0x00FF00FF);
+	swapBlocks<4>(m, 0x0F0F0F0F);
+	swapBlocks<2>(m, 0x33333333);
+	swapBlocks<1>(m, 0x55555555);
+}
+#endif
+
+// Vertices are split in groups of 8. For each component c and bit b of a
+// float, plane 32c + b holds one byte per group, made of bit b of component c
+// of its 8 vertices. The floats of the last vertices that don't make a full
+// group follow the planes as is. The result is as big as the floats.
+// Blocks of 32 vertices are transposed at once, which gives 4 bytes of each
+// plane (16 bytes with SSE2, which transposes 4 blocks at once).
+void bitShuffle(float const* data, size_t size, unsigned int dim,
+                uint8_t* shuffled)
+{
+	const size_t groups(size / dim / 8);
+	size_t j(0);
+#ifdef __SSE2__
+	for(; j + 16 <= groups; j += 16)
+	{
+		for(unsigned int c(0); c < dim; ++c)
+		{
+			// lane l holds the block of vertices 8j + 32l to 8j + 32l + 31
+			// (copied as integers so that NaNs are kept as is)
+			float const* v(&data[8 * j * dim + c]);
+			__m128i bits[32];
+			for(unsigned int k(0); k < 32; ++k)
+			{
+				int32_t lanes[4];
+				for(unsigned int l(0); l < 4; ++l)
+					std::memcpy(&lanes[l], &v[(32 * l + k) * dim], 4);
+				bits[k] = _mm_unpacklo_epi64(
+				    _mm_unpacklo_epi32(_mm_cvtsi32_si128(lanes[0]),
+				                       _mm_cvtsi32_si128(lanes[1])),
+				    _mm_unpacklo_epi32(_mm_cvtsi32_si128(lanes[2]),
+				                       _mm_cvtsi32_si128(lanes[3])));
+			}
+			transpose32x32(bits);
+			uint8_t* plane(&shuffled[32 * c * groups + j]);
+			for(unsigned int b(0); b < 32; ++b, plane += groups)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(plane), bits[b]);
+		}
+	}
+#endif
+	for(; j < groups; j += 4)
+	{
+		// the last block can have less than 4 groups
+		const size_t n(std::min(groups - j, static_cast<size_t>(4)));
+		for(unsigned int c(0); c < dim; ++c)
+		{
+			uint32_t bits[32] = {};
+			for(size_t k(0); k < 8 * n; ++k)
+				std::memcpy(&bits[k], &data[(8 * j + k) * dim + c], 4);
+			transpose32x32(bits);
+			for(unsigned int b(0); b < 32; ++b)
+				bits[b] = planeOrder(bits[b]);
+			uint8_t* plane(&shuffled[32 * c * groups + j]);
+			if(n == 4)
+				for(unsigned int b(0); b < 32; ++b, plane += groups)
+					std::memcpy(plane, &bits[b], 4);
+			else
+				for(unsigned int b(0); b < 32; ++b, plane += groups)
+					std::memcpy(plane, &bits[b], n);
+		}
+	}
+	if(size > 8 * groups * dim)
+		std::memcpy(shuffled + 32 * dim * groups, data + 8 * groups * dim,
+		            (size - 8 * groups * dim) * sizeof(float));
+}
+
+// Inverse of bitShuffle.
+void bitUnshuffle(uint8_t const* shuffled, size_t size, unsigned int dim,
+                  float* data)
+{
+	const size_t groups(size / dim / 8);
+	size_t j(0);
+#ifdef __SSE2__
+	for(; j + 16 <= groups; j += 16)
+	{
+		for(unsigned int c(0); c < dim; ++c)
+		{
+			__m128i bits[32];
+			uint8_t const* plane(&shuffled[32 * c * groups + j]);
+			for(unsigned int b(0); b < 32; ++b, plane += groups)
+				bits[b] = _mm_loadu_si128(
+				    reinterpret_cast<__m128i const*>(plane));
+			transpose32x32(bits);
+			float* v(&data[8 * j * dim + c]);
+			for(unsigned int k(0); k < 32; ++k)
+			{
+				uint32_t lanes[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), bits[k]);
+				for(unsigned int l(0); l < 4; ++l)
+					std::memcpy(&v[(32 * l + k) * dim], &lanes[l], 4);
+			}
+		}
+	}
+#endif
+	for(; j < groups; j += 4)
+	{
+		const size_t n(std::min(groups - j, static_cast<size_t>(4)));
+		for(unsigned int c(0); c < dim; ++c)
+		{
+			uint32_t bits[32] = {};
+			uint8_t const* plane(&shuffled[32 * c * groups + j]);
+			if(n == 4)
+				for(unsigned int b(0); b < 32; ++b, plane += groups)
+					std::memcpy(&bits[b], plane, 4);
+			else
+				for(unsigned int b(0); b < 32; ++b, plane += groups)
+					std::memcpy(&bits[b], plane, n);
+			for(unsigned int b(0); b < 32; ++b)
+				bits[b] = planeOrder(bits[b]);
+			transpose32x32(bits);
+			for(size_t k(0); k < 8 * n; ++k)
+				std::memcpy(&data[(8 * j + k) * dim + c], &bits[k], 4);
+		}
+	}
+	if(size > 8 * groups * dim)
+		std::memcpy(data + 8 * groups * dim, shuffled + 32 * dim * groups,
+		            (size - 8 * groups * dim) * sizeof(float));
+}
+
+// Run-length encoding : a control byte c below 128 is followed by c + 1
+// literal bytes, a control byte c of 128 or more by one byte to repeat
+// c - 125 times (3 to 130 times). Returns the encoded size, or 0 if it would be
+// above maxSize (out must be able to hold maxSize bytes).
+size_t rleEncode(uint8_t const* in, size_t size, uint8_t* out, size_t maxSize)
+{
+	uint8_t* o(out);
+	uint8_t* const oEnd(out + maxSize);
+	size_t i(0);
+	while(i < size)
+	{
+		size_t run(1);
+		while(i + run < size && run < 130 && in[i + run] == in[i])
+			++run;
+		if(run >= 3)
+		{
+			if(oEnd - o < 2)
+				return 0;
+			*o++ = 125 + run;
+			*o++ = in[i];
+			i += run;
+			continue;
+		}
+		// literals up to the next run of 3 identical bytes
+		size_t end(i);
+		while(end < size && end - i < 128
+		      && !(end + 2 < size && in[end] == in[end + 1]
+		           && in[end] == in[end + 2]))
+			++end;
+		if(static_cast<size_t>(oEnd - o) < end - i + 1)
+			return 0;
+		*o++ = end - i - 1;
+		std::memcpy(o, in + i, end - i);
+		o += end - i;
+		i = end;
+	}
+	return o - out;
+}
+
+// Inverse of rleEncode, returns false if in doesn't decode to exactly size
+// bytes.
+bool rleDecode(uint8_t const* in, size_t inSize, uint8_t* out, size_t size)
+{
+	uint8_t const* const inEnd(in + inSize);
+	uint8_t* const outEnd(out + size);
+	while(in < inEnd)
+	{
+		uint8_t control(*in++);
+		if(control < 128)
+		{
+			size_t n(control + 1);
+			if(static_cast<size_t>(inEnd - in) < n
+			   || static_cast<size_t>(outEnd - out) < n)
+				return false;
+			std::memcpy(out, in, n);
+			in += n;
+			out += n;
+		}
+		else
+		{
+			size_t n(control - 125);
+			if(in == inEnd || static_cast<size_t>(outEnd - out) < n)
+				return false;
+			std::memset(out, *in++, n);
+			out += n;
+		}
+	}
+	return out == outEnd;
+}
+// Size in bytes of the encoding of size floats with
+// Codec::QUANTIZED_POSITIONS.
+size_t quantizedSize(size_t size, unsigned int dim)
+{
+	return size / dim * (3 * sizeof(uint16_t) + (dim - 3) * sizeof(float));
+}
+
+// Positions of all the vertices come first, followed by the other components
+// of all the vertices, so that the positions are expanded by a single kernel
+// call.
+void quantizePositions(float const* data, size_t size, unsigned int dim,
+                       uint8_t* encoded)
+{
+	const size_t vertices(size / dim);
+	uint16_t* positions(reinterpret_cast<uint16_t*>(encoded));
+	uint8_t* others(encoded + 3 * vertices * sizeof(uint16_t));
+	for(size_t i(0); i < vertices; ++i)
+	{
+		for(unsigned int k(0); k < 3; ++k)
+		{
+			// NaNs give 0
+			float x(std::min(std::max(0.f, data[i * dim + k]), 1.f));
+			positions[3 * i + k]
+			    = static_cast<uint16_t>(std::lround(x * 65535.f));
+		}
+		std::memcpy(others + i * (dim - 3) * sizeof(float), data + i * dim + 3,
+		            (dim - 3) * sizeof(float));
+	}
+}
+
+// Inverse of quantizePositions (but the rounding).
+void dequantizePositions(uint8_t const* encoded, size_t size, unsigned int dim,
+                         float* data)
+{
+	const size_t vertices(size / dim);
+	uint16_t const* positions(reinterpret_cast<uint16_t const*>(encoded));
+	if(dim == 3)
+	{
+		kernels::dequantize(positions, size, data);
+		return;
+	}
+	std::vector<float> expanded(3 * vertices);
+	kernels::dequantize(positions, expanded.size(), expanded.data());
+	uint8_t const* others(encoded + 3 * vertices * sizeof(uint16_t));
+	for(size_t i(0); i < vertices; ++i)
+	{
+		std::memcpy(data + i * dim, &expanded[3 * i], 3 * sizeof(float));
+		std::memcpy(data + i * dim + 3, others + i * (dim - 3) * sizeof(float),
+		            (dim - 3) * sizeof(float));
+	}
+}
+// Throws if a chunk with this header can't be decoded.
+void checkChunkHeader(codec::Codec codec, uint64_t size, uint64_t encodedSize,
+                      unsigned int dim)
+{
+	using codec::Codec;
+	if(codec == Codec::RAW && encodedSize == size * sizeof(float))
+		return;
+	if(codec != Codec::BITSHUFFLE_RLE && codec != Codec::QUANTIZED_POSITIONS)
+		throw(std::string("Unknown octree file chunk codec"));
+	if(codec == Codec::QUANTIZED_POSITIONS
+	   && (dim < 3 || size % dim != 0
+	       || encodedSize != quantizedSize(size, dim)))
+		throw(std::string("Corrupted octree file chunk"));
+}
+
+// Decodes the encodedSize bytes of a chunk whose header passed
+// checkChunkHeader (and whose codec isn't RAW) into its size floats.
+void decode(codec::Codec codec, uint8_t const* encoded, uint64_t encodedSize,
+            uint64_t size, unsigned int dim, float* data)
+{
+	if(codec == codec::Codec::QUANTIZED_POSITIONS)
+	{
+		dequantizePositions(encoded, size, dim, data);
+		return;
+	}
+	if(size % dim != 0)
+		dim = 1;
+	std::vector<uint8_t> shuffled(size * sizeof(float));
+	if(!rleDecode(encoded, encodedSize, shuffled.data(), shuffled.size()))
+		throw(std::string("Corrupted octree file chunk"));
+	bitUnshuffle(shuffled.data(), size, dim, data);
+}
+} // namespace
+
+void codec::encodeChunk(float const* data, size_t size,
+                        unsigned int dimPerVertex, bool compress,
+                        bool quantizePositions, std::vector<char>& chunk)
+{
+	const size_t rawSize(size * sizeof(float));
+	if(quantizePositions && dimPerVertex >= 3 && size % dimPerVertex == 0)
+	{
+		uint64_t header[3] = {size,
+		                      static_cast<uint64_t>(Codec::QUANTIZED_POSITIONS),
+		                      quantizedSize(size, dimPerVertex)};
+		chunk.resize(chunkHeaderSize + header[2]);
+		std::memcpy(chunk.data(), header, chunkHeaderSize);
+		::quantizePositions(
+		    data, size, dimPerVertex,
+		    reinterpret_cast<uint8_t*>(chunk.data()) + chunkHeaderSize);
+		return;
+	}
+	// vertices can't be grouped if size isn't a multiple of their dimension
+	if(size % dimPerVertex != 0)
+		dimPerVertex = 1;
+	chunk.resize(chunkHeaderSize + rawSize);
+	uint8_t* encoded(reinterpret_cast<uint8_t*>(chunk.data())
+	                 + chunkHeaderSize);
+
+	uint64_t encodedSize(0);
+	if(compress)
+	{
+		std::vector<uint8_t> shuffled(rawSize);
+		bitShuffle(data, size, dimPerVertex, shuffled.data());
+		encodedSize = rleEncode(shuffled.data(), rawSize, encoded,
+		                        rawSize > 0 ? rawSize - 1 : 0);
+	}
+	Codec codec(Codec::BITSHUFFLE_RLE);
+	if(encodedSize == 0)
+	{
+		codec       = Codec::RAW;
+		encodedSize = rawSize;
+		if(rawSize > 0)
+			std::memcpy(encoded, data, rawSize);
+	}
+	chunk.resize(chunkHeaderSize + encodedSize);
+
+	uint64_t header[3] = {size, static_cast<uint64_t>(codec), encodedSize};
+	std::memcpy(chunk.data(), header, chunkHeaderSize);
+}
+
+void codec::readChunk(std::istream& in, unsigned int dimPerVertex,
+                      std::vector<float>& data)
+{
+	uint64_t size, encodedSize;
+	Codec codec;
+	brw::read(in, size);
+	brw::read(in, codec);
+	brw::read(in, encodedSize);
+	if(!in)
+		throw(std::string("Unexpected end of octree file chunk"));
+	checkChunkHeader(codec, size, encodedSize, dimPerVertex);
+	data.resize(size);
+	if(codec == Codec::RAW)
+	{
+		if(size > 0)
+			brw::read(in, data[0], size);
+		if(!in)
+			throw(std::string("Unexpected end of octree file chunk"));
+		return;
+	}
+
+	std::vector<uint8_t> encoded(encodedSize);
+	in.read(reinterpret_cast<char*>(encoded.data()), encodedSize);
+	if(!in)
+		throw(std::string("Unexpected end of octree file chunk"));
+	decode(codec, encoded.data(), encodedSize, size, dimPerVertex, data.data());
+}
+
+void codec::decodeChunk(char const* chunk, size_t available,
+                        unsigned int dimPerVertex, std::vector<float>& data)
+{
+	if(available < chunkHeaderSize)
+		throw(std::string("Unexpected end of octree file chunk"));
+	uint64_t header[3];
+	std::memcpy(header, chunk, chunkHeaderSize);
+	const Codec codec(static_cast<Codec>(header[1]));
+	checkChunkHeader(codec, header[0], header[2], dimPerVertex);
+	if(header[2] > available - chunkHeaderSize)
+		throw(std::string("Unexpected end of octree file chunk"));
+	data.resize(header[0]);
+	uint8_t const* encoded(reinterpret_cast<uint8_t const*>(chunk)
+	                       + chunkHeaderSize);
+	if(codec == Codec::RAW)
+	{
+		if(header[2] > 0)
+			std::memcpy(data.data(), encoded, header[2]);
+		return;
+	}
+	decode(codec, encoded, header[2], header[0], dimPerVertex, data.data());
+}
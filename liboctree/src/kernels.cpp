@@ -0,0 +1,444 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace
+{
+// Number of components per vertex known at compile time.
+template <unsigned int D>
+struct FixedStride
+{
+	unsigned int get() const { return D; };
+	void swap(float* a, float* b) const
+	{
+		for(unsigned int k(0); k < D; ++k)
+			std::swap(a[k], b[k]);
+	};
+};
+
+// Number of components per vertex only known at runtime.
+struct RuntimeStride
+{
+	unsigned int dim;
+	unsigned int get() const { return dim; };
+	void swap(float* a, float* b) const { std::swap_ranges(a, a + dim, b); };
+};
+
+template <typename Stride>
+void boundingBox(Stride stride, float const* data, size_t beg, size_t end,
+                 float bbox[6])
+{
+	float minX(bbox[0]), maxX(bbox[1]), minY(bbox[2]), maxY(bbox[3]),
+	    minZ(bbox[4]), maxZ(bbox[5]);
+	for(float const* v(data + beg * stride.get());
+	    v <= data + end * stride.get(); v += stride.get())
+	{
+		minX = std::min(minX, v[0]);
+		maxX = std::max(maxX, v[0]);
+		minY = std::min(minY, v[1]);
+		maxY = std::max(maxY, v[1]);
+		minZ = std::min(minZ, v[2]);
+		maxZ = std::max(maxZ, v[2]);
+	}
+	bbox[0] = minX;
+	bbox[1] = maxX;
+	bbox[2] = minY;
+	bbox[3] = maxY;
+	bbox[4] = minZ;
+	bbox[5] = maxZ;
+}
+
+// Multiplying rather than dividing by 65535 is faster, and gives the same
+// result whatever the instructions used.
+const float dequantizeFactor(1.f / 65535.f);
+
+void dequantize(uint16_t const* quantized, size_t size, float* data)
+{
+	for(size_t i(0); i < size; ++i)
+		data[i] = quantized[i] * dequantizeFactor;
+}
+
+#ifdef KERNELS_X86_SIMD
+// Returns true if one of the lanes of register r holds a position component
+// (register r holds floats 8r to 8r+7 of a block, lanes being the
+// register's width).
+inline bool holdsPosition(unsigned int dim, unsigned int lanes, unsigned int r)
+{
+	for(unsigned int l(0); l < lanes; ++l)
+	{
+		if((lanes * r + l) % dim < 3)
+			return true;
+	}
+	return false;
+}
+
+// Updates bbox from the lanes of each register of mins and maxs, register r
+// lane l holding component (lanes * r + l) % D.
+template <unsigned int D>
+void reduceLanes(float const mins[], float const maxs[], unsigned int lanes,
+                 float bbox[6])
+{
+	for(unsigned int f(0); f < lanes * D; ++f)
+	{
+		unsigned int component(f % D);
+		if(component < 3)
+		{
+			bbox[2 * component] = std::min(bbox[2 * component], mins[f]);
+			bbox[2 * component + 1]
+			    = std::max(bbox[2 * component + 1], maxs[f]);
+		}
+	}
+}
+
+// The interleaved layout is processed 8 vertices at a time : they span D AVX
+// registers, and the lane l of register r always holds component
+// (8r + l) % D. So each register can be reduced independently with vertical
+// min/max, and the lanes are sorted out at the end.
+template <unsigned int D>
+__attribute__((target("avx2"))) void
+    boundingBoxAVX2(float const* data, size_t beg, size_t end, float bbox[6])
+{
+	float const* v(data + beg * D);
+	float const* vEnd(data + (end + 1) * D);
+	__m256 mins[D], maxs[D];
+	for(unsigned int r(0); r < D; ++r)
+	{
+		mins[r] = _mm256_set1_ps(FLT_MAX);
+		maxs[r] = _mm256_set1_ps(-FLT_MAX);
+	}
+	for(; vEnd - v >= 8 * D; v += 8 * D)
+	{
+		for(unsigned int r(0); r < D; ++r)
+		{
+			if(!holdsPosition(D, 8, r))
+				continue;
+			// NaNs are ignored as with std::min/max (second operand is
+			// returned)
+			__m256 x(_mm256_loadu_ps(v + 8 * r));
+			mins[r] = _mm256_min_ps(x, mins[r]);
+			maxs[r] = _mm256_max_ps(x, maxs[r]);
+		}
+	}
+	float minsLanes[8 * D], maxsLanes[8 * D];
+	for(unsigned int r(0); r < D; ++r)
+	{
+		_mm256_storeu_ps(minsLanes + 8 * r, mins[r]);
+		_mm256_storeu_ps(maxsLanes + 8 * r, maxs[r]);
+	}
+	reduceLanes<D>(minsLanes, maxsLanes, 8, bbox);
+	if(v != vEnd)
+		boundingBox(FixedStride<D>(), data, (v - data) / D, end, bbox);
+}
+
+// Same as boundingBoxAVX2 with 4 vertices at a time.
+template <unsigned int D>
+__attribute__((target("sse2"))) void
+    boundingBoxSSE2(float const* data, size_t beg, size_t end, float bbox[6])
+{
+	float const* v(data + beg * D);
+	float const* vEnd(data + (end + 1) * D);
+	__m128 mins[D], maxs[D];
+	for(unsigned int r(0); r < D; ++r)
+	{
+		mins[r] = _mm_set1_ps(FLT_MAX);
+		maxs[r] = _mm_set1_ps(-FLT_MAX);
+	}
+	for(; vEnd - v >= 4 * D; v += 4 * D)
+	{
+		for(unsigned int r(0); r < D; ++r)
+		{
+			if(!holdsPosition(D, 4, r))
+				continue;
+			__m128 x(_mm_loadu_ps(v + 4 * r));
+			mins[r] = _mm_min_ps(x, mins[r]);
+			maxs[r] = _mm_max_ps(x, maxs[r]);
+		}
+	}
+	float minsLanes[4 * D], maxsLanes[4 * D];
+	for(unsigned int r(0); r < D; ++r)
+	{
+		_mm_storeu_ps(minsLanes + 4 * r, mins[r]);
+		_mm_storeu_ps(maxsLanes + 4 * r, maxs[r]);
+	}
+	reduceLanes<D>(minsLanes, maxsLanes, 4, bbox);
+	if(v != vEnd)
+		boundingBox(FixedStride<D>(), data, (v - data) / D, end, bbox);
+}
+
+using kernels::InstructionSet;
+
+InstructionSet detectInstructionSet()
+{
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return InstructionSet::AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return InstructionSet::SSE2;
+	return InstructionSet::SCALAR;
+}
+
+// see kernels::setMaxInstructionSet
+InstructionSet maxInstructionSet(InstructionSet::AVX2);
+
+// Returns the instructions to use : the best ones the processor supports,
+// within maxInstructionSet.
+InstructionSet usedInstructionSet()
+{
+	static const InstructionSet detected(detectInstructionSet());
+	return std::min(detected, maxInstructionSet);
+}
+
+template <unsigned int D>
+void boundingBoxSIMD(FixedStride<D> stride, float const* data, size_t beg,
+                     size_t end, float bbox[6])
+{
+	switch(usedInstructionSet())
+	{
+		case InstructionSet::AVX2:
+			boundingBoxAVX2<D>(data, beg, end, bbox);
+			break;
+		case InstructionSet::SSE2:
+			boundingBoxSSE2<D>(data, beg, end, bbox);
+			break;
+		default:
+			boundingBox(stride, data, beg, end, bbox);
+			break;
+	}
+}
+
+void boundingBoxSIMD(RuntimeStride stride, float const* data, size_t beg,
+                     size_t end, float bbox[6])
+{
+	boundingBox(stride, data, beg, end, bbox);
+}
+
+// Converts 8 numbers at a time, zero-extended to 32-bit integers.
+__attribute__((target("avx2"))) void
+    dequantizeAVX2(uint16_t const* quantized, size_t size, float* data)
+{
+	const __m256 factor(_mm256_set1_ps(dequantizeFactor));
+	size_t i(0);
+	for(; i + 8 <= size; i += 8)
+	{
+		__m128i q(
+		    _mm_loadu_si128(reinterpret_cast<__m128i const*>(quantized + i)));
+		__m256 f(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(q)));
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(f, factor));
+	}
+	dequantize(quantized + i, size - i, data + i);
+}
+
+// Same as dequantizeAVX2 with two 4 floats registers.
+__attribute__((target("sse2"))) void
+    dequantizeSSE2(uint16_t const* quantized, size_t size, float* data)
+{
+	const __m128 factor(_mm_set1_ps(dequantizeFactor));
+	const __m128i zero(_mm_setzero_si128());
+	size_t i(0);
+	for(; i + 8 <= size; i += 8)
+	{
+		__m128i q(
+		    _mm_loadu_si128(reinterpret_cast<__m128i const*>(quantized + i)));
+		__m128 lo(_mm_cvtepi32_ps(_mm_unpacklo_epi16(q, zero)));
+		__m128 hi(_mm_cvtepi32_ps(_mm_unpackhi_epi16(q, zero)));
+		_mm_storeu_ps(data + i, _mm_mul_ps(lo, factor));
+		_mm_storeu_ps(data + i + 4, _mm_mul_ps(hi, factor));
+	}
+	dequantize(quantized + i, size - i, data + i);
+}
+
+void dequantizeSIMD(uint16_t const* quantized, size_t size, float* data)
+{
+	switch(usedInstructionSet())
+	{
+		case InstructionSet::AVX2:
+			dequantizeAVX2(quantized, size, data);
+			break;
+		case InstructionSet::SSE2:
+			dequantizeSSE2(quantized, size, data);
+			break;
+		default:
+			dequantize(quantized, size, data);
+			break;
+	}
+}
+#endif
+
+inline unsigned int octant(float const* v, float const mid[3])
+{
+	// below goes first
+	return (v[0] < mid[0] ? 0 : 4) | (v[1] < mid[1] ? 0 : 2)
+	       | (v[2] < mid[2] ? 0 : 1);
+}
+
+template <typename Stride>
+void partitionOctants(Stride stride, float* data, size_t beg, size_t end,
+                      float const mid[3], size_t octantsBeg[8],
+                      size_t octantsSize[8])
+{
+	const unsigned int dim(stride.get());
+
+	// count vertices per octant
+	for(unsigned int o(0); o < 8; ++o)
+		octantsSize[o] = 0;
+	for(size_t i(beg); i <= end; ++i)
+		++octantsSize[octant(data + i * dim, mid)];
+
+	size_t next[8];
+	octantsBeg[0] = beg;
+	for(unsigned int o(1); o < 8; ++o)
+		octantsBeg[o] = octantsBeg[o - 1] + octantsSize[o - 1];
+	for(unsigned int o(0); o < 8; ++o)
+		next[o] = octantsBeg[o];
+
+	// Follow the permutation cycles : a misplaced vertex is swapped with the
+	// first unsorted vertex of its octant, so that each swap puts at least one
+	// vertex at its final place. Vertices are only read and written once more.
+	for(unsigned int o(0); o < 8; ++o)
+	{
+		size_t octantEnd(octantsBeg[o] + octantsSize[o]);
+		while(next[o] < octantEnd)
+		{
+			float* v(data + next[o] * dim);
+			unsigned int target(octant(v, mid));
+			while(target != o)
+			{
+				stride.swap(v, data + next[target] * dim);
+				++next[target];
+				target = octant(v, mid);
+			}
+			++next[o];
+		}
+	}
+}
+
+template <typename Stride>
+void partitionAxis(Stride stride, float* data, size_t beg, size_t end,
+                   unsigned int axis, float mid, size_t& below)
+{
+	const unsigned int dim(stride.get());
+	float* first(data + beg * dim);
+	float* last(data + (end + 1) * dim);
+	// vertices before first are below, vertices from last are above
+	while(first != last)
+	{
+		if(first[axis] < mid)
+		{
+			first += dim;
+			continue;
+		}
+		last -= dim;
+		while(last != first && !(last[axis] < mid))
+			last -= dim;
+		if(last == first)
+			break;
+		stride.swap(first, last);
+		first += dim;
+	}
+	below = (first - data) / dim - beg;
+}
+} // namespace
+
+// Calls function with the right Stride for dimPerVertex.
+#define DISPATCH_STRIDE(dimPerVertex, function, ...)                   \
+	switch(dimPerVertex)                                               \
+	{                                                                  \
+		case 3:                                                        \
+			function(FixedStride<3>(), __VA_ARGS__);                   \
+			break;                                                     \
+		case 4:                                                        \
+			function(FixedStride<4>(), __VA_ARGS__);                   \
+			break;                                                     \
+		case 5:                                                        \
+			function(FixedStride<5>(), __VA_ARGS__);                   \
+			break;                                                     \
+		case 6:                                                        \
+			function(FixedStride<6>(), __VA_ARGS__);                   \
+			break;                                                     \
+		case 7:                                                        \
+			function(FixedStride<7>(), __VA_ARGS__);                   \
+			break;                                                     \
+		case 9:                                                        \
+			function(FixedStride<9>(), __VA_ARGS__);                   \
+			break;                                                     \
+		case 10:                                                       \
+			function(FixedStride<10>(), __VA_ARGS__);                  \
+			break;                                                     \
+		default:                                                       \
+			function(RuntimeStride{dimPerVertex}, __VA_ARGS__);        \
+			break;                                                     \
+	}
+
+void kernels::boundingBox(float const* data, unsigned int dimPerVertex,
+                          size_t beg, size_t end, float bbox[6])
+{
+	if(end < beg)
+		return;
+#ifdef KERNELS_X86_SIMD
+	DISPATCH_STRIDE(dimPerVertex, ::boundingBoxSIMD, data, beg, end, bbox);
+#else
+	DISPATCH_STRIDE(dimPerVertex, ::boundingBox, data, beg, end, bbox);
+#endif
+}
+
+void kernels::partitionOctants(float* data, unsigned int dimPerVertex,
+                               size_t beg, size_t end, float const mid[3],
+                               size_t octantsBeg[8], size_t octantsSize[8])
+{
+	DISPATCH_STRIDE(dimPerVertex, ::partitionOctants, data, beg, end, mid,
+	                octantsBeg, octantsSize);
+}
+
+size_t kernels::partitionAxis(float* data, unsigned int dimPerVertex,
+                              size_t beg, size_t end, unsigned int axis,
+                              float mid)
+{
+	size_t below(0);
+	if(end < beg)
+		return below;
+	DISPATCH_STRIDE(dimPerVertex, ::partitionAxis, data, beg, end, axis, mid,
+	                below);
+	return below;
+}
+
+void kernels::dequantize(uint16_t const* quantized, size_t size, float* data)
+{
+#ifdef KERNELS_X86_SIMD
+	::dequantizeSIMD(quantized, size, data);
+#else
+	::dequantize(quantized, size, data);
+#endif
+}
+
+void kernels::setMaxInstructionSet(InstructionSet instructionSet)
+{
+#ifdef KERNELS_X86_SIMD
+	::maxInstructionSet = instructionSet;
+#else
+	(void) instructionSet;
+#endif
+}
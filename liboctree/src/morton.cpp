@@ -0,0 +1,115 @@
+/*
+    Copyright (C) 2018 Florian Cabot <florian.cabot@epfl.ch>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "morton.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include "ThreadPool.hpp"
+
+namespace
+{
+// Spreads the 21 lowest bits of x so that there are two zeros between each
+// of them.
+uint64_t spread(uint32_t x)
+{
+	uint64_t r(x & 0x1fffff);
+	r = (r | r << 32) & 0x001f00000000ffffULL;
+	r = (r | r << 16) & 0x001f0000ff0000ffULL;
+	r = (r | r << 8) & 0x100f00f00f00f00fULL;
+	r = (r | r << 4) & 0x10c30c30c30c30c3ULL;
+	r = (r | r << 2) & 0x1249249249249249ULL;
+	return r;
+}
+} // namespace
+
+uint64_t morton::encode(uint32_t x, uint32_t y, uint32_t z)
+{
+	return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+void morton::radixSort(ThreadPool& pool, std::vector<uint64_t>& keys,
+                       std::vector<size_t>& indices)
+{
+	const size_t n(keys.size());
+	const size_t blocksNumber(
+	    std::min(static_cast<size_t>(4 * pool.getThreadsNumber()),
+	             n / 65536 + 1));
+	const size_t blockSize((n + blocksNumber - 1) / blocksNumber);
+
+	std::vector<uint64_t> keysTmp(n);
+	std::vector<size_t> indicesTmp(n);
+	std::vector<std::array<size_t, 256>> histograms(blocksNumber);
+
+	for(unsigned int pass(0); pass < 8; ++pass)
+	{
+		const unsigned int shift(8 * pass);
+
+		// histogram of the current byte for each block
+		pool.parallelFor(blocksNumber, [&](size_t b) {
+			std::array<size_t, 256>& h(histograms[b]);
+			h.fill(0);
+			size_t end(std::min(n, (b + 1) * blockSize));
+			for(size_t i(b * blockSize); i < end; ++i)
+				++h[(keys[i] >> shift) & 0xff];
+		});
+
+		// skip the pass if all keys have the same byte
+		bool trivial(false);
+		for(unsigned int digit(0); digit < 256; ++digit)
+		{
+			size_t count(0);
+			for(size_t b(0); b < blocksNumber; ++b)
+				count += histograms[b][digit];
+			if(count == n)
+				trivial = true;
+			if(count != 0)
+				break;
+		}
+		if(trivial)
+			continue;
+
+		// exclusive prefix sum in (digit, block) order so that the sort is
+		// stable
+		size_t offset(0);
+		for(unsigned int digit(0); digit < 256; ++digit)
+		{
+			for(size_t b(0); b < blocksNumber; ++b)
+			{
+				size_t count(histograms[b][digit]);
+				histograms[b][digit] = offset;
+				offset += count;
+			}
+		}
+
+		// scatter
+		pool.parallelFor(blocksNumber, [&](size_t b) {
+			std::array<size_t, 256>& h(histograms[b]);
+			size_t end(std::min(n, (b + 1) * blockSize));
+			for(size_t i(b * blockSize); i < end; ++i)
+			{
+				size_t dst(h[(keys[i] >> shift) & 0xff]++);
+				keysTmp[dst]    = keys[i];
+				indicesTmp[dst] = indices[i];
+			}
+		});
+		keys.swap(keysTmp);
+		indices.swap(indicesTmp);
+	}
+}
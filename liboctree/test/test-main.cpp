@@ -17,12 +17,18 @@
 */
 
 #include <algorithm>
+#include <cfloat>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #include "Octree.hpp"
 #include "binaryrw.hpp"
+#include "LinearOctree.hpp"
+#include "OctreeFile.hpp"
+#include "codec.hpp"
+#include "kernels.hpp"
 
 namespace term
 {
@@ -65,6 +71,36 @@ class TestBinaryFile : public std::fstream
 	};
 };
 
+// Octree file written with write(std::string const&, Octree&), removed when
+// destroyed
+class TestOctreeFile
+{
+  public:
+	explicit TestOctreeFile(Octree& octree)
+	    : path("TESTS_octree")
+	{
+		write(path, octree);
+	};
+	// Returns the content of the file
+	std::string read() const
+	{
+		std::ifstream f(path, std::ios_base::binary);
+		std::stringstream content;
+		content << f.rdbuf();
+		return content.str();
+	};
+	~TestOctreeFile() { std::remove(path.c_str()); };
+
+	const std::string path;
+};
+
+// Returns the content of the file octree is written to with
+// write(std::string const&, Octree&)
+std::string writeToFileAndRead(Octree& octree)
+{
+	return TestOctreeFile(octree).read();
+}
+
 template <typename T>
 void TEST_EQUAL(T result, T shouldbe, const char* testname,
                 std::string const& additional = "")
@@ -118,6 +154,151 @@ std::vector<float> generateVertices(size_t number, unsigned int seed,
 	return vertices;
 }
 
+// Gives access to the nodes of the tree
+class TestOctree : public Octree
+{
+  public:
+	TestOctree() = default;
+	// Returns true if all non-leaf nodes hold exactly verticesNumber vertices
+	bool nonLeavesHold(size_t verticesNumber) const
+	{
+		if(isLeaf())
+			return true;
+		if(data.size() != verticesNumber * commonData.dimPerVertex)
+			return false;
+		for(Octree* child : children)
+		{
+			if(child != nullptr
+			   && !static_cast<TestOctree*>(child)->nonLeavesHold(
+			       verticesNumber))
+				return false;
+		}
+		return true;
+	};
+
+	// Returns the number of levels of the tree
+	unsigned int depth() const
+	{
+		unsigned int result(0);
+		for(Octree* child : children)
+		{
+			if(child != nullptr)
+				result = std::max(
+				    result, static_cast<TestOctree*>(child)->depth());
+		}
+		return result + 1;
+	};
+	// Returns the number of leaves of the tree holding less than
+	// verticesNumber vertices
+	size_t smallLeavesNumber(size_t verticesNumber) const
+	{
+		if(isLeaf())
+			return totalDataSize < verticesNumber * commonData.dimPerVertex;
+		size_t result(0);
+		for(Octree* child : children)
+		{
+			if(child != nullptr)
+				result += static_cast<TestOctree*>(child)->smallLeavesNumber(
+				    verticesNumber);
+		}
+		return result;
+	};
+	// Returns true if all the nodes of the tree are TestOctree instances
+	bool onlyHoldsTestOctrees() const
+	{
+		for(Octree* child : children)
+		{
+			if(child == nullptr)
+				continue;
+			TestOctree* testChild(dynamic_cast<TestOctree*>(child));
+			if(testChild == nullptr || !testChild->onlyHoldsTestOctrees())
+				return false;
+		}
+		return true;
+	};
+	// Same as getCompactData, built recursively as it was before
+	// writeStructure walked the tree
+	std::vector<int64_t> recursiveCompactData() const
+	{
+		std::vector<int64_t> res;
+		if(!isLeaf())
+			res.push_back(0);
+		res.push_back(file_addr);
+		res.push_back(totalDataSize);
+		float bbox[6] = {minX, maxX, minY, maxY, minZ, maxZ};
+		uint64_t* bboxUint64(reinterpret_cast<uint64_t*>(bbox));
+		res.insert(res.end(), bboxUint64, bboxUint64 + 3);
+		if(isLeaf())
+			return res;
+		unsigned int nb(8);
+		while(children[nb - 1] == nullptr)
+			--nb;
+		for(unsigned int i(0); i < nb; ++i)
+		{
+			if(children[i] == nullptr)
+			{
+				res.push_back(-1);
+				continue;
+			}
+			for(int64_t t :
+			    static_cast<TestOctree*>(children[i])->recursiveCompactData())
+				res.push_back(t);
+		}
+		res.push_back(1);
+		return res;
+	};
+	// Sets what the structure of the tree holds for this node, the same value
+	// being used for all the bounds of its bounding box
+	void setNode(int64_t address, size_t dataSize, float bound)
+	{
+		file_addr     = address;
+		totalDataSize = dataSize;
+		minX = maxX = minY = maxY = minZ = maxZ = bound;
+	};
+	// Creates children[i] on the heap, to build a tree by hand
+	TestOctree* addChild(unsigned int i)
+	{
+		children[i] = newChild();
+		return static_cast<TestOctree*>(children[i]);
+	};
+
+  protected:
+	explicit TestOctree(CommonData& commonData)
+	    : Octree(commonData){};
+	virtual Octree* newChild() const override
+	{
+		return new TestOctree(commonData);
+	};
+};
+
+// Computes the same thing as Octree::getCompactData from a LinearOctree
+void getCompactData(LinearOctree const& octree, LinearOctree::Index node,
+                    std::vector<int64_t>& res)
+{
+	LinearOctree::Node const& n(octree[node]);
+	if(!n.isLeaf())
+		res.push_back(0);
+	res.push_back(n.file_addr);
+	res.push_back(n.totalDataSize);
+	float bbox[6] = {n.minX, n.maxX, n.minY, n.maxY, n.minZ, n.maxZ};
+	uint64_t* bboxUint64(reinterpret_cast<uint64_t*>(bbox));
+	res.insert(res.end(), bboxUint64, bboxUint64 + 3);
+	if(n.isLeaf())
+		return;
+	unsigned int nb(8);
+	while((n.childMask & (1 << (nb - 1))) == 0)
+		--nb;
+	for(unsigned int i(0); i < nb; ++i)
+	{
+		LinearOctree::Index child(octree.getChild(node, i));
+		if(child != LinearOctree::noNode)
+			getCompactData(octree, child, res);
+		else
+			res.push_back(-1);
+	}
+	res.push_back(1);
+}
+
 int main(int, char*[])
 {
 	const unsigned int seed = 0;
@@ -222,6 +403,855 @@ int main(int, char*[])
 		           "OCTREE totalDataSize (from data)");
 		std::cout << success << "OCTREE totalDataSize (from data)" << std::endl;
 	}
+	// TEST KERNELS bounding box
+	{
+		bool equal(true);
+		// each version the processor supports
+		for(kernels::InstructionSet instructionSet :
+		    {kernels::InstructionSet::SCALAR, kernels::InstructionSet::SSE2,
+		     kernels::InstructionSet::AVX2})
+		{
+			kernels::setMaxInstructionSet(instructionSet);
+			for(unsigned int dim(3); dim <= 11; ++dim)
+			{
+				// 1003 vertices to also cover the vectorized loops' tails (4
+				// or 8 vertices at a time)
+				std::vector<float> v(generateVertices(1004, seed, dim));
+				// the bounds are only reached by the last vertices, and vertex
+				// 0 is out of the range
+				for(unsigned int j(0); j < 3; ++j)
+				{
+					v[j]              = 5.f;
+					v[1002 * dim + j] = -2.f;
+					v[1003 * dim + j] = 2.f;
+				}
+				float bbox[6] = {FLT_MAX, -FLT_MAX, FLT_MAX,
+				                 -FLT_MAX, FLT_MAX, -FLT_MAX};
+				kernels::boundingBox(v.data(), dim, 1, 1003, bbox);
+				float expected[6] = {FLT_MAX, -FLT_MAX, FLT_MAX,
+				                     -FLT_MAX, FLT_MAX, -FLT_MAX};
+				for(size_t i(1); i <= 1003; ++i)
+				{
+					for(unsigned int j(0); j < 3; ++j)
+					{
+						expected[2 * j]
+						    = std::min(expected[2 * j], v[i * dim + j]);
+						expected[2 * j + 1]
+						    = std::max(expected[2 * j + 1], v[i * dim + j]);
+					}
+				}
+				for(unsigned int j(0); j < 6; ++j)
+					equal = equal && bbox[j] == expected[j];
+			}
+		}
+		kernels::setMaxInstructionSet(kernels::InstructionSet::AVX2);
+		TEST_EQUAL(equal, true, "KERNELS bounding box");
+		std::cout << success << "KERNELS bounding box" << std::endl;
+	}
+	// TEST KERNELS axis partition
+	{
+		bool valid(true);
+		for(unsigned int dim(3); dim <= 11; ++dim)
+		{
+			std::vector<float> v(generateVertices(1001, seed, dim));
+			std::vector<float> expected(v);
+			size_t below(kernels::partitionAxis(v.data(), dim, 1, 1000, 1, 0.3f));
+			for(size_t i(1); i <= 1000; ++i)
+				valid = valid && (v[i * dim + 1] < 0.3f) == (i <= below);
+			// vertices are only moved
+			valid = valid && v[0] == expected[0];
+			std::sort(v.begin(), v.end());
+			std::sort(expected.begin(), expected.end());
+			valid = valid && v == expected;
+		}
+		TEST_EQUAL(valid, true, "KERNELS axis partition");
+		std::cout << success << "KERNELS axis partition" << std::endl;
+	}
+	// TEST KERNELS dequantize
+	{
+		bool valid(true);
+		srand(seed);
+		for(kernels::InstructionSet instructionSet :
+		    {kernels::InstructionSet::SCALAR, kernels::InstructionSet::SSE2,
+		     kernels::InstructionSet::AVX2})
+		{
+			kernels::setMaxInstructionSet(instructionSet);
+			for(size_t size : {0, 1, 7, 8, 9, 17, 1001})
+			{
+				std::vector<uint16_t> q(size);
+				for(uint16_t& x : q)
+					x = rand() % 65536;
+				if(size > 2)
+				{
+					q[0] = 0;
+					q[1] = 65535;
+				}
+				std::vector<float> data(size);
+				kernels::dequantize(q.data(), size, data.data());
+				for(size_t i(0); i < size; ++i)
+					valid = valid && data[i] == q[i] * (1.f / 65535.f);
+				if(size > 2)
+					valid = valid && data[0] == 0.f && data[1] == 1.f;
+			}
+		}
+		kernels::setMaxInstructionSet(kernels::InstructionSet::AVX2);
+		TEST_EQUAL(valid, true, "KERNELS dequantize");
+		std::cout << success << "KERNELS dequantize" << std::endl;
+	}
+	// TEST CODEC chunk roundtrip
+	{
+		bool valid(true);
+		for(unsigned int dim(3); dim <= 11; ++dim)
+		{
+			for(size_t number : {0, 1, 7, 8, 9, 1001})
+			{
+				std::vector<float> v(generateVertices(number, seed, dim));
+				// identical bytes which have to be run-length encoded
+				for(size_t i(0); i < v.size() / 2; ++i)
+					v[i] = 0.5f;
+				std::vector<char> chunk;
+				codec::encodeChunk(v.data(), v.size(), dim, true, false,
+				                   chunk);
+				std::stringstream stream;
+				stream.write(chunk.data(), chunk.size());
+				std::vector<float> decoded;
+				codec::readChunk(stream, dim, decoded);
+				valid = valid && decoded == v;
+			}
+		}
+		TEST_EQUAL(valid, true, "CODEC chunk roundtrip");
+
+		// bits of nearby positions are mostly shared
+		std::vector<float> v(generateVertices(16000, seed));
+		for(float& f : v)
+			f = 100.f + f / 1000.f;
+		std::vector<char> chunk;
+		codec::encodeChunk(v.data(), v.size(), 3, true, false, chunk);
+		TEST_EQUAL(chunk.size() < v.size() * sizeof(float) * 3 / 4, true,
+		           "CODEC chunk compression");
+
+		// truncated chunk
+		std::stringstream stream;
+		stream.write(chunk.data(), chunk.size() / 2);
+		std::vector<float> decoded;
+		bool thrown(false);
+		try
+		{
+			codec::readChunk(stream, 3, decoded);
+		}
+		catch(std::string const&)
+		{
+			thrown = true;
+		}
+		TEST_EQUAL(thrown, true, "CODEC truncated chunk");
+		std::cout << success << "CODEC chunk roundtrip" << std::endl;
+	}
+	// TEST CODEC quantized positions
+	{
+		bool valid(true);
+		for(unsigned int dim(3); dim <= 11; ++dim)
+		{
+			std::vector<float> v(generateVertices(1001, seed, dim));
+			for(float& f : v)
+				f = (f + 1.f) / 2.f;
+			std::vector<char> chunk;
+			codec::encodeChunk(v.data(), v.size(), dim, true, true, chunk);
+			valid = valid
+			        && chunk.size() == codec::chunkHeaderSize
+			                               + 1001 * (6 + 4 * (dim - 3));
+			std::stringstream stream;
+			stream.write(chunk.data(), chunk.size());
+			std::vector<float> decoded;
+			codec::readChunk(stream, dim, decoded);
+			valid = valid && decoded.size() == v.size();
+			for(size_t i(0); valid && i < v.size(); ++i)
+			{
+				if(i % dim < 3)
+					valid = std::abs(decoded[i] - v[i]) <= 0.51f / 65535.f;
+				else
+					valid = decoded[i] == v[i];
+			}
+		}
+		TEST_EQUAL(valid, true, "CODEC quantized positions");
+		std::cout << success << "CODEC quantized positions" << std::endl;
+	}
+	// TEST OCTREE construction with a fixed number of threads
+	{
+		Octree octree1;
+		octree1.setThreadsNumber(2);
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		octree1.init(v, 1000);
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree1);
+		f.resetCursor();
+		Octree octree2;
+		octree2.init(f);
+		octree2.readData(f);
+		TEST_EQUAL(octree2.getTotalDataSize(), bigTreeSize * 3,
+		           "OCTREE construction with a fixed number of threads [size]");
+		TEST_EQUAL(octree2.getData().size(), bigTreeSize * 3,
+		           "OCTREE construction with a fixed number of threads "
+		           "[content]");
+		std::cout << success
+		          << "OCTREE construction with a fixed number of threads"
+		          << std::endl;
+	}
+	// TEST OCTREE construction reproducibility
+	{
+		// same seed and data, different numbers of threads
+		std::string files[2];
+		for(unsigned int k(0); k < 2; ++k)
+		{
+			Octree octree;
+			octree.setSeed(42);
+			octree.setThreadsNumber(k == 0 ? 1 : 4);
+			std::vector<float> v(generateVertices(bigTreeSize, seed));
+			octree.init(v, 1000);
+			std::stringstream stream;
+			write(stream, octree);
+			files[k] = stream.str();
+		}
+		TEST_EQUAL(files[1] == files[0], true,
+		           "OCTREE construction reproducibility");
+		std::cout << success << "OCTREE construction reproducibility"
+		          << std::endl;
+	}
+	// TEST OCTREE parallel partition
+	{
+		// big enough for the first levels to be partitioned by blocks
+		const size_t size(1 << 21);
+		std::vector<float> expected(generateVertices(size, seed));
+		std::string files[2];
+		for(unsigned int k(0); k < 2; ++k)
+		{
+			Octree octree;
+			octree.setThreadsNumber(k == 0 ? 1 : 4);
+			std::vector<float> v(expected);
+			octree.init(v, 16000);
+			std::stringstream stream;
+			write(stream, octree);
+			files[k] = stream.str();
+		}
+		TEST_EQUAL(files[1] == files[0], true,
+		           "OCTREE parallel partition [reproducibility]");
+		std::stringstream stream(files[0]);
+		Octree octree;
+		octree.init(stream);
+		octree.readData(stream);
+		std::vector<float> v;
+		octree.dumpInVectorAndEmpty(v);
+		std::sort(v.begin(), v.end());
+		std::sort(expected.begin(), expected.end());
+		TEST_EQUAL(v == expected, true, "OCTREE parallel partition [content]");
+		std::cout << success << "OCTREE parallel partition" << std::endl;
+	}
+	// TEST OCTREE construction from a raw buffer
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		float* buffer(new float[v.size()]);
+		std::copy(v.begin(), v.end(), buffer);
+		Octree octree1, octree2;
+		octree1.init(v, 1000);
+		octree2.init(buffer, bigTreeSize * 3, 1000);
+		std::stringstream stream1, stream2;
+		write(stream1, octree1);
+		write(stream2, octree2);
+		TEST_EQUAL(stream2.str() == stream1.str(), true,
+		           "OCTREE construction from a raw buffer");
+		delete[] buffer;
+		std::cout << success << "OCTREE construction from a raw buffer"
+		          << std::endl;
+	}
+	// TEST OCTREE node allocation
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::string expected;
+		bool sameResult(true), sameClass(true);
+		// trees allocated and freed one after another reuse memory
+		for(unsigned int i(0); i < 3; ++i)
+		{
+			std::vector<float> copy(v);
+			TestOctree* octree(new TestOctree);
+			octree->init(copy, 1000);
+			std::stringstream stream;
+			write(stream, *octree);
+			if(i == 0)
+				expected = stream.str();
+			sameResult = sameResult && stream.str() == expected;
+			sameClass  = sameClass && octree->onlyHoldsTestOctrees();
+			delete octree;
+		}
+		TEST_EQUAL(sameResult, true, "OCTREE node allocation [content]");
+		TEST_EQUAL(sameClass, true, "OCTREE node allocation [newChild]");
+		std::cout << success << "OCTREE node allocation" << std::endl;
+	}
+	// TEST OCTREE progress reporting
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::vector<float> reports;
+		Octree octree;
+		octree.setProgressCallback(
+		    [&reports](float progress) { reports.push_back(progress); }, 0.f);
+		octree.init(v, 1000);
+		bool valid(reports.size() > 1 && reports.back() == 1.f);
+		for(size_t i(0); i + 1 < reports.size(); ++i)
+			valid = valid && reports[i] >= 0.f && reports[i] < 1.f;
+		TEST_EQUAL(valid, true, "OCTREE progress reporting");
+		std::cout << success << "OCTREE progress reporting" << std::endl;
+	}
+	// TEST OCTREE median split
+	{
+		// 90% of the vertices within a small cluster
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		for(size_t i(0); i < v.size() / 10 * 9; ++i)
+			v[i] = 0.5f + v[i] * 1e-3f;
+		std::vector<float> expected(v), vCopy(v);
+		TestOctree octree1, octree2;
+		octree1.init(vCopy, 1000);
+		octree2.setSplitStrategy(Octree::SplitStrategy::MEDIAN);
+		octree2.init(v, 1000);
+		TEST_EQUAL(octree2.depth() < octree1.depth(), true,
+		           "OCTREE median split [depth]");
+		TEST_EQUAL(octree2.smallLeavesNumber(100)
+		               < octree1.smallLeavesNumber(100),
+		           true, "OCTREE median split [leaves]");
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree2);
+		f.resetCursor();
+		Octree octree3;
+		octree3.init(f);
+		octree3.readData(f);
+		std::vector<float> data;
+		octree3.dumpInVectorAndEmpty(data);
+		std::sort(data.begin(), data.end());
+		std::sort(expected.begin(), expected.end());
+		TEST_EQUAL(vecToStr(data), vecToStr(expected),
+		           "OCTREE median split [content]");
+		std::cout << success << "OCTREE median split" << std::endl;
+	}
+	// TEST OCTREE identical vertices
+	{
+		std::vector<float> v(3 * 5000, 0.25f);
+		std::vector<float> other(generateVertices(100, seed));
+		v.insert(v.end(), other.begin(), other.end());
+		Octree octree;
+		octree.init(v, 1000);
+		TEST_EQUAL(octree.getTotalDataSize(), v.size(),
+		           "OCTREE identical vertices");
+		std::cout << success << "OCTREE identical vertices" << std::endl;
+	}
+	// TEST OCTREE exact LOD sampling
+	{
+		TestOctree octree1;
+		octree1.setSamplingMode(Octree::SamplingMode::EXACT);
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		octree1.init(v, 1000);
+		TEST_EQUAL(octree1.nonLeavesHold(1000), true,
+		           "OCTREE exact LOD sampling [size]");
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree1);
+		f.resetCursor();
+		Octree octree2;
+		octree2.init(f);
+		octree2.readData(f);
+		TEST_EQUAL(octree2.getData().size(), bigTreeSize * 3,
+		           "OCTREE exact LOD sampling [content]");
+		std::cout << success << "OCTREE exact LOD sampling" << std::endl;
+	}
+	// TEST BINARY RW random octree constructed along a Morton curve
+	{
+		Octree octree1;
+		octree1.setFlags(Octree::Flags::NORMALIZED_NODES);
+		std::vector<float> v1(generateVertices(bigTreeSize, seed));
+		std::vector<float> v1Copy(v1);
+		octree1.initMorton(v1, 1000);
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree1);
+		f.resetCursor();
+		Octree octree2;
+		octree2.init(f);
+		octree2.readData(f);
+		TEST_EQUAL(octree2.toString(), octree1.toString(),
+		           "R/W random octree constructed along a Morton curve "
+		           "[structure]");
+		std::vector<float> v2;
+		octree2.dumpInVectorAndEmpty(v2);
+		std::sort(v1Copy.begin(), v1Copy.end());
+		std::sort(v2.begin(), v2.end());
+		TEST_EQUAL(vecToStr(v1Copy), vecToStr(v2),
+		           "R/W random octree constructed along a Morton curve "
+		           "[content]");
+		std::cout << success
+		          << "R/W random octree constructed along a Morton curve"
+		          << std::endl;
+	}
+	// TEST OCTREE out-of-core construction
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::vector<float> vCopy(v);
+
+		Octree octree1;
+		octree1.setSamplingMode(Octree::SamplingMode::EXACT);
+		octree1.init(v, 1000);
+		std::stringstream stream1;
+		write(stream1, octree1);
+
+		// about 30000 vertices fit in memory
+		Octree octree2;
+		octree2.setSamplingMode(Octree::SamplingMode::EXACT);
+		std::stringstream stream2;
+		octree2.initOutOfCore(
+		    stream2,
+		    [&vCopy](Octree::VerticesConsumer const& addVertices) {
+			    // give vertices in several batches
+			    for(size_t i(0); i < vCopy.size(); i += 3 * 7000)
+			    {
+				    size_t end(std::min(vCopy.size(), i + 3 * 7000));
+				    addVertices(std::vector<float>(vCopy.begin() + i,
+				                                   vCopy.begin() + end));
+			    }
+		    },
+		    1000, 30000 * 3 * sizeof(float));
+
+		Octree octree3, octree4;
+		octree3.init(stream1);
+		octree3.readData(stream1);
+		octree4.init(stream2);
+		octree4.readData(stream2);
+		TEST_EQUAL(octree4.getCompactData() == octree3.getCompactData(), true,
+		           "OCTREE out-of-core construction [structure]");
+		std::vector<float> v3, v4;
+		octree3.dumpInVectorAndEmpty(v3);
+		octree4.dumpInVectorAndEmpty(v4);
+		std::sort(v3.begin(), v3.end());
+		std::sort(v4.begin(), v4.end());
+		TEST_EQUAL(vecToStr(v4), vecToStr(v3),
+		           "OCTREE out-of-core construction [content]");
+		std::cout << success << "OCTREE out-of-core construction"
+		          << std::endl;
+	}
+	// TEST OCTREE out-of-core identical vertices
+	{
+		// the node of the 50000 identical vertices doesn't fit in memory and
+		// can't be split : its leaf is streamed
+		std::vector<float> v(3 * 50000, 0.25f);
+		v.insert(v.end(), 3 * 100, -0.5f);
+		std::vector<float> expected(v);
+		std::sort(expected.begin(), expected.end());
+		bool valid(true);
+		for(Octree::Flags flags :
+		    {Octree::Flags::COMPRESSED_CHUNKS,
+		     Octree::Flags::NORMALIZED_NODES | Octree::Flags::COMPRESSED_CHUNKS,
+		     Octree::Flags::NORMALIZED_NODES
+		         | Octree::Flags::QUANTIZED_POSITIONS})
+		{
+			Octree octree1;
+			octree1.setFlags(flags);
+			std::stringstream stream;
+			octree1.initOutOfCore(
+			    stream,
+			    [&v](Octree::VerticesConsumer const& addVertices) {
+				    addVertices(v);
+			    },
+			    1000, 5000 * 3 * sizeof(float));
+			Octree octree2;
+			octree2.init(stream);
+			octree2.readData(stream);
+			std::vector<float> data;
+			octree2.dumpInVectorAndEmpty(data);
+			std::sort(data.begin(), data.end());
+			valid = valid && data == expected;
+		}
+		TEST_EQUAL(valid, true, "OCTREE out-of-core identical vertices");
+		std::cout << success << "OCTREE out-of-core identical vertices"
+		          << std::endl;
+	}
+	// TEST OCTREE append
+	{
+		std::vector<float> v1(generateVertices(20000, seed));
+		std::vector<float> v2(generateVertices(bigTreeSize, seed + 1));
+		// some new vertices are out of the tree's bounding box
+		for(float& f : v2)
+			f *= 1.5f;
+		// appended to the extended bounding boxes
+		std::vector<float> v3(generateVertices(20000, seed + 2));
+		std::vector<float> expected(v1);
+		expected.insert(expected.end(), v2.begin(), v2.end());
+		expected.insert(expected.end(), v3.begin(), v3.end());
+		Octree octree1;
+		octree1.setSamplingMode(Octree::SamplingMode::EXACT);
+		octree1.setSplitStrategy(Octree::SplitStrategy::MEDIAN);
+		octree1.init(v1, 1000);
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree1);
+		f.resetCursor();
+		Octree octree2;
+		octree2.setSamplingMode(Octree::SamplingMode::EXACT);
+		octree2.init(f);
+		octree2.append(f, v2, 1000);
+		octree2.append(f, v3, 1000);
+		f.resetCursor();
+		TestOctree octree3;
+		octree3.init(f);
+		octree3.readData(f);
+		TEST_EQUAL(octree3.getTotalDataSize(), expected.size(),
+		           "OCTREE append [size]");
+		TEST_EQUAL(octree3.nonLeavesHold(1000), true,
+		           "OCTREE append [LOD size]");
+		std::vector<float> data;
+		octree3.dumpInVectorAndEmpty(data);
+		std::sort(data.begin(), data.end());
+		std::sort(expected.begin(), expected.end());
+		TEST_EQUAL(vecToStr(data), vecToStr(expected),
+		           "OCTREE append [content]");
+		std::cout << success << "OCTREE append" << std::endl;
+	}
+	// TEST OCTREE chunk size
+	{
+		const size_t chunkSize(1 << 16);
+		Octree octree1;
+		octree1.setFlags(Octree::Flags::STORE_COLOR
+		                 | Octree::Flags::STORE_DENSITY
+		                 | Octree::Flags::STORE_TEMPERATURE);
+		unsigned int maxLeafSize(octree1.getMaxLeafSizeForChunkSize(chunkSize));
+		std::vector<float> v(generateVertices(bigTreeSize, seed, 8));
+		octree1.init(v, maxLeafSize);
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree1);
+		f.resetCursor();
+		LinearOctree octree2;
+		octree2.init(f);
+		// chunks are contiguous, each one ends where the next one begins
+		std::vector<int64_t> addresses;
+		for(auto const& node : octree2.getNodes())
+			addresses.push_back(node.file_addr);
+		f.seekg(0, std::ios_base::end);
+		addresses.push_back(f.tellg());
+		std::sort(addresses.begin(), addresses.end());
+		bool fits(true);
+		for(size_t i(0); i + 1 < addresses.size(); ++i)
+			fits = fits && addresses[i + 1] - addresses[i] <= (int64_t) chunkSize;
+		TEST_EQUAL(fits, true, "OCTREE chunk size");
+		std::cout << success << "OCTREE chunk size" << std::endl;
+	}
+	// TEST OCTREE structure serialization
+	{
+		// writes the structure of octree and reads it back
+		auto structureOf = [](Octree const& octree) {
+			std::stringstream stream;
+			octree.writeStructure(stream);
+			std::vector<int64_t> structure(stream.str().size() / 8);
+			brw::read(stream, structure[0], structure.size());
+			return structure;
+		};
+
+		// tree built by hand :
+		// root -> {leaf, nullptr, node -> {nullptr, leaf}}
+		TestOctree octree;
+		octree.setNode(100, 9, 1.f);
+		octree.addChild(0)->setNode(200, 3, 2.f);
+		TestOctree* node(octree.addChild(2));
+		node->setNode(300, 6, 2.f);
+		node->addChild(1)->setNode(400, 6, 2.f);
+		// bounding boxes of 1.0 and 2.0 whatever the byte order
+		const int64_t a(0x3F8000003F800000), b(0x4000000040000000);
+		const std::vector<int64_t> expected{
+		    100, 9,   a, a, a,    // root
+		    200, 3,   b, b, b,    // leaf
+		    -1,                   // nullptr
+		    0,   300, 6, b, b, b, // ( node
+		    -1,                   // nullptr
+		    400, 6,   b, b, b,    // leaf
+		    1,                    // ) node
+		    1};                   // ) root
+		bool valid(structureOf(octree) == expected
+		           && octree.getStructureSize() == expected.size());
+		std::vector<int64_t> compactData(1, 0);
+		compactData.insert(compactData.end(), expected.begin(), expected.end());
+		valid = valid && octree.getCompactData() == compactData
+		        && octree.recursiveCompactData() == compactData;
+
+		TestOctree leaf;
+		leaf.setNode(100, 9, 1.f);
+		valid = valid
+		        && structureOf(leaf)
+		               == std::vector<int64_t>({100, 9, a, a, a, 1})
+		        && leaf.getCompactData()
+		               == std::vector<int64_t>({100, 9, a, a, a});
+
+		// built trees, against the recursive construction
+		for(size_t size : {static_cast<size_t>(10), bigTreeSize})
+		{
+			TestOctree built;
+			std::vector<float> v(generateVertices(size, seed));
+			built.init(v, 100);
+			std::vector<int64_t> compact(built.recursiveCompactData());
+			valid = valid && built.getCompactData() == compact;
+			if(built.isLeaf())
+				compact.push_back(1);
+			else
+				compact.erase(compact.begin());
+			valid = valid && structureOf(built) == compact
+			        && built.getStructureSize() == compact.size();
+		}
+		TEST_EQUAL(valid, true, "OCTREE structure serialization");
+		std::cout << success << "OCTREE structure serialization" << std::endl;
+	}
+	// TEST OCTREE parallel write
+	{
+		Octree octree1;
+		octree1.setThreadsNumber(4);
+		octree1.setFlags(Octree::Flags::STORE_RADIUS);
+		std::vector<float> v(generateVertices(bigTreeSize, seed, 4));
+		octree1.init(v, 100);
+		std::stringstream stream;
+		write(stream, octree1);
+		TEST_EQUAL(writeToFileAndRead(octree1) == stream.str(), true,
+		           "OCTREE parallel write");
+		std::cout << success << "OCTREE parallel write" << std::endl;
+	}
+	// TEST OCTREE aligned chunks
+	{
+		Octree octree1;
+		octree1.setChunkAlignment(4096);
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::vector<float> expected(v);
+		octree1.init(v, 1000);
+		std::stringstream stream;
+		write(stream, octree1);
+		TEST_EQUAL(writeToFileAndRead(octree1) == stream.str(), true,
+		           "OCTREE aligned chunks [parallel write]");
+
+		stream.seekg(0);
+		LinearOctree octree2;
+		octree2.init(stream);
+		bool aligned(octree2.getVersionMinor() == 1
+		             && octree2.getChunkAlignment() == 4096);
+		for(auto const& node : octree2.getNodes())
+			aligned = aligned && (node.file_addr + 8) % 4096 == 0;
+		TEST_EQUAL(aligned, true, "OCTREE aligned chunks [alignment]");
+
+		stream.seekg(0);
+		Octree octree3;
+		octree3.init(stream);
+		octree3.readData(stream);
+		std::vector<float> v3;
+		octree3.dumpInVectorAndEmpty(v3);
+		std::sort(v3.begin(), v3.end());
+		std::sort(expected.begin(), expected.end());
+		TEST_EQUAL(octree3.getChunkAlignment(), static_cast<uint64_t>(4096),
+		           "OCTREE aligned chunks [read alignment]");
+		TEST_EQUAL(v3 == expected, true, "OCTREE aligned chunks [content]");
+
+		// packed chunks keep version 2.0
+		Octree octree4;
+		std::vector<float> v4(generateVertices(1000, seed));
+		octree4.init(v4, 100);
+		std::stringstream stream4;
+		write(stream4, octree4);
+		LinearOctree octree5;
+		octree5.init(stream4);
+		TEST_EQUAL(octree5.getVersionMinor(), static_cast<uint32_t>(0),
+		           "OCTREE aligned chunks [packed version]");
+		std::cout << success << "OCTREE aligned chunks" << std::endl;
+	}
+	// TEST OCTREE compressed chunks
+	{
+		Octree octree1;
+		octree1.setFlags(Octree::Flags::COMPRESSED_CHUNKS);
+		octree1.setChunkAlignment(64);
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		for(float& f : v)
+			f = 100.f + f / 1000.f;
+		std::vector<float> expected(v);
+		octree1.init(v, 1000);
+		std::stringstream stream;
+		write(stream, octree1);
+		TEST_EQUAL(writeToFileAndRead(octree1) == stream.str(), true,
+		           "OCTREE compressed chunks [parallel write]");
+		TEST_EQUAL(stream.str().size() < bigTreeSize * 3 * sizeof(float), true,
+		           "OCTREE compressed chunks [size]");
+
+		stream.seekg(0);
+		LinearOctree octree2;
+		octree2.init(stream);
+		TEST_EQUAL(octree2.getVersionMinor(), static_cast<uint32_t>(2),
+		           "OCTREE compressed chunks [version]");
+		std::vector<float> v2;
+		bool aligned(true);
+		for(LinearOctree::Index i(0); i < octree2.getNodes().size(); ++i)
+		{
+			aligned = aligned
+			          && (octree2[i].file_addr + codec::chunkHeaderSize) % 64
+			                 == 0;
+			// non-leaf nodes hold copies of some vertices of their subtree
+			if(!octree2[i].isLeaf())
+				continue;
+			std::vector<float> chunk(octree2.readChunk(stream, i));
+			v2.insert(v2.end(), chunk.begin(), chunk.end());
+		}
+		TEST_EQUAL(aligned, true, "OCTREE compressed chunks [alignment]");
+		std::sort(v2.begin(), v2.end());
+		std::sort(expected.begin(), expected.end());
+		TEST_EQUAL(v2 == expected, true,
+		           "OCTREE compressed chunks [linear content]");
+
+		stream.seekg(0);
+		Octree octree3;
+		octree3.init(stream);
+		octree3.readData(stream);
+		std::vector<float> v3;
+		octree3.dumpInVectorAndEmpty(v3);
+		std::sort(v3.begin(), v3.end());
+		TEST_EQUAL(v3 == expected, true, "OCTREE compressed chunks [content]");
+		std::cout << success << "OCTREE compressed chunks" << std::endl;
+	}
+	// TEST OCTREE quantized positions
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed, 4));
+		std::vector<float> vCopy(v);
+		Octree octree1, octree2;
+		octree1.setFlags(Octree::Flags::NORMALIZED_NODES
+		                 | Octree::Flags::STORE_RADIUS);
+		octree2.setFlags(Octree::Flags::NORMALIZED_NODES
+		                 | Octree::Flags::STORE_RADIUS
+		                 | Octree::Flags::QUANTIZED_POSITIONS);
+		octree1.init(v, 1000);
+		octree2.init(vCopy, 1000);
+		std::stringstream stream1, stream2;
+		write(stream1, octree1);
+		write(stream2, octree2);
+		// positions take half the space
+		TEST_EQUAL(stream2.str().size() < stream1.str().size() * 3 / 4, true,
+		           "OCTREE quantized positions [size]");
+
+		LinearOctree octree5;
+		octree5.init(stream2);
+		TEST_EQUAL(octree5.getVersionMinor(), static_cast<uint32_t>(3),
+		           "OCTREE quantized positions [version]");
+
+		stream2.seekg(0);
+		Octree octree3, octree4;
+		octree3.init(stream1);
+		octree3.readData(stream1);
+		octree4.init(stream2);
+		octree4.readData(stream2);
+		std::vector<float> v3, v4;
+		octree3.dumpInVectorAndEmpty(v3);
+		octree4.dumpInVectorAndEmpty(v4);
+		// same order, positions within half a step of the biggest node
+		bool valid(v3.size() == v4.size());
+		for(size_t i(0); valid && i < v3.size(); ++i)
+		{
+			if(i % 4 < 3)
+				valid = std::abs(v4[i] - v3[i]) <= 1.01f / 65535.f;
+			else
+				valid = v4[i] == v3[i];
+		}
+		TEST_EQUAL(valid, true, "OCTREE quantized positions [content]");
+		std::cout << success << "OCTREE quantized positions" << std::endl;
+	}
+	// TEST OCTREE node table
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::vector<float> vCopy(v);
+		Octree octree1, octree2;
+		octree1.setFlags(Octree::Flags::NODE_TABLE);
+		octree1.init(v, 1000);
+		octree2.init(vCopy, 1000);
+		std::stringstream stream1, stream2;
+		write(stream1, octree1);
+		write(stream2, octree2);
+		TEST_EQUAL(writeToFileAndRead(octree1) == stream1.str(), true,
+		           "OCTREE node table [parallel write]");
+
+		// same nodes as parsed from the structure
+		stream1.seekg(0);
+		stream2.seekg(0);
+		LinearOctree octree3, octree4;
+		octree3.init(stream1);
+		octree4.init(stream2);
+		TEST_EQUAL(octree3.getVersionMinor(), static_cast<uint32_t>(4),
+		           "OCTREE node table [version]");
+		bool same(octree3.size() == octree4.size());
+		for(LinearOctree::Index i(0); same && i < octree3.size(); ++i)
+		{
+			LinearOctree::Node const& a(octree3[i]);
+			LinearOctree::Node const& b(octree4[i]);
+			// the header holds the alignment and the table address
+			same = a.file_addr == b.file_addr + 16
+			       && a.totalDataSize == b.totalDataSize && a.minX == b.minX
+			       && a.maxX == b.maxX && a.minY == b.minY
+			       && a.maxY == b.maxY && a.minZ == b.minZ
+			       && a.maxZ == b.maxZ && a.childMask == b.childMask
+			       && (a.isLeaf() || a.firstChild == b.firstChild);
+			same = same
+			       && a.chunkSize
+			              == 8 + 4 * octree3.readChunk(stream1, i).size();
+		}
+		TEST_EQUAL(same, true, "OCTREE node table [nodes]");
+
+		// appending writes a new table
+		std::vector<float> v2(generateVertices(20000, seed + 1));
+		for(float& x : v2)
+			x *= 1.5f;
+		stream1.seekg(0);
+		Octree octree5;
+		octree5.init(stream1);
+		octree5.append(stream1, v2, 1000);
+		stream1.seekg(0);
+		LinearOctree octree6;
+		octree6.init(stream1);
+		bool valid(octree6[LinearOctree::root].totalDataSize
+		           == (bigTreeSize + 20000) * 3);
+		for(LinearOctree::Index i(0); valid && i < octree6.size(); ++i)
+		{
+			valid = octree6[i].chunkSize
+			        == 8 + 4 * octree6.readChunk(stream1, i).size();
+		}
+		TEST_EQUAL(valid, true, "OCTREE node table [append]");
+		std::cout << success << "OCTREE node table" << std::endl;
+	}
+	// TEST OCTREE breadth-first chunks
+	{
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::vector<float> expected(v);
+		Octree octree1;
+		octree1.setChunkOrder(Octree::ChunkOrder::BREADTH_FIRST);
+		octree1.init(v, 1000);
+		std::stringstream stream;
+		write(stream, octree1);
+		TEST_EQUAL(writeToFileAndRead(octree1) == stream.str(), true,
+		           "OCTREE breadth-first chunks [parallel write]");
+
+		// LinearOctree nodes are in breadth-first order too
+		stream.seekg(0);
+		LinearOctree octree2;
+		octree2.init(stream);
+		bool ordered(true);
+		for(LinearOctree::Index i(1); i < octree2.size(); ++i)
+			ordered
+			    = ordered && octree2[i - 1].file_addr < octree2[i].file_addr;
+		TEST_EQUAL(ordered, true, "OCTREE breadth-first chunks [order]");
+
+		stream.seekg(0);
+		Octree octree3;
+		octree3.init(stream);
+		octree3.readData(stream);
+		std::vector<float> v3;
+		octree3.dumpInVectorAndEmpty(v3);
+		std::sort(v3.begin(), v3.end());
+		std::sort(expected.begin(), expected.end());
+		TEST_EQUAL(v3 == expected, true,
+		           "OCTREE breadth-first chunks [content]");
+		std::cout << success << "OCTREE breadth-first chunks" << std::endl;
+	}
 	// TEST OCTREE totalDataSize from file
 	{
 		Octree octree1;
@@ -237,6 +1267,39 @@ int main(int, char*[])
 		           "OCTREE totalDataSize (from file)");
 		std::cout << success << "OCTREE totalDataSize (from file)" << std::endl;
 	}
+	// TEST OCTREE structure parsing
+	{
+		Octree octree1;
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		octree1.init(v, 16);
+		std::stringstream file;
+		write(file, octree1);
+		Octree octree2;
+		octree2.init(file);
+		bool valid(octree2.getCompactData() == octree1.getCompactData()
+		           && octree2.getTotalDataSize() == bigTreeSize * 3);
+		// without file header, the structure end isn't known
+		std::stringstream structure;
+		octree1.writeStructure(structure);
+		Octree octree3;
+		octree3.init(structure);
+		valid = valid && octree3.getCompactData() == octree1.getCompactData()
+		        && structure.tellg() == (int64_t) structure.str().size();
+		std::string truncated(file.str().substr(0, 256));
+		std::stringstream truncatedFile(truncated);
+		bool thrown(false);
+		try
+		{
+			Octree octree4;
+			octree4.init(truncatedFile);
+		}
+		catch(std::string const&)
+		{
+			thrown = true;
+		}
+		TEST_EQUAL(valid && thrown, true, "OCTREE structure parsing");
+		std::cout << success << "OCTREE structure parsing" << std::endl;
+	}
 	// TEST OCTREE flags RW
 	{
 		Octree::Flags flags(Octree::Flags::NORMALIZED_NODES
@@ -330,6 +1393,91 @@ int main(int, char*[])
 		std::cout << success << "random octree dumping in vector after RW"
 		          << std::endl;
 	}
+	// TEST LINEAROCTREE from file
+	{
+		Octree octree1;
+		std::vector<float> v(generateVertices(bigTreeSize, seed));
+		std::vector<float> vCopy(v);
+		octree1.init(v, 1000);
+		TestBinaryFile f;
+		f.resetCursor();
+		write(f, octree1);
+		f.resetCursor();
+		LinearOctree octree2;
+		octree2.init(f);
+		std::vector<int64_t> compactData;
+		getCompactData(octree2, LinearOctree::root, compactData);
+		TEST_EQUAL(compactData == octree1.getCompactData(), true,
+		           "LINEAROCTREE from file [structure]");
+		std::vector<float> leavesData;
+		octree2.traverse([&](LinearOctree::Index i) {
+			if(octree2[i].isLeaf())
+			{
+				std::vector<float> chunk(octree2.readChunk(f, i));
+				leavesData.insert(leavesData.end(), chunk.begin(), chunk.end());
+			}
+			return true;
+		});
+		std::sort(vCopy.begin(), vCopy.end());
+		std::sort(leavesData.begin(), leavesData.end());
+		TEST_EQUAL(vecToStr(leavesData), vecToStr(vCopy),
+		           "LINEAROCTREE from file [content]");
+		std::cout << success << "LINEAROCTREE from file" << std::endl;
+	}
+	// TEST OCTREEFILE chunk views
+	{
+		bool valid(true), zeroCopy(true);
+		for(Octree::Flags flags :
+		    {Octree::Flags::NONE, Octree::Flags::NODE_TABLE,
+		     Octree::Flags::NORMALIZED_NODES | Octree::Flags::COMPRESSED_CHUNKS
+		         | Octree::Flags::QUANTIZED_POSITIONS})
+		{
+			Octree octree1;
+			octree1.setFlags(flags);
+			std::vector<float> v(generateVertices(bigTreeSize, seed));
+			octree1.init(v, 1000);
+			TestOctreeFile written(octree1);
+			std::ifstream f(written.path, std::ios_base::binary);
+			LinearOctree octree2;
+			octree2.init(f);
+			OctreeFile file;
+			file.open(written.path);
+			file.advise(OctreeFile::Advice::RANDOM);
+			std::vector<float> buffer;
+			for(LinearOctree::Index i(0); i < octree2.size(); ++i)
+			{
+				file.advise(i, OctreeFile::Advice::WILLNEED);
+				OctreeFile::Span span(file.getData(i, buffer));
+				std::vector<float> chunk(octree2.readChunk(f, i));
+				valid = valid
+				        && std::vector<float>(span.begin(), span.end()) == chunk;
+				// spans point within the mapping
+				zeroCopy = zeroCopy
+				           && (file.isZeroCopy() == buffer.empty()
+				               || chunk.empty());
+			}
+			valid = valid && file.getTree().size() == octree2.size()
+			        && file.isZeroCopy()
+			               == (flags == Octree::Flags::NONE
+			                   || flags == Octree::Flags::NODE_TABLE);
+			file.close();
+			valid = valid && !file.isOpen();
+		}
+		bool thrown(false);
+		try
+		{
+			OctreeFile file;
+			file.open("TESTS_nonexistent");
+		}
+		catch(std::string const&)
+		{
+			thrown = true;
+		}
+		TEST_EQUAL(valid, true, "OCTREEFILE chunk views [content]");
+		TEST_EQUAL(zeroCopy, true, "OCTREEFILE chunk views [zero copy]");
+		TEST_EQUAL(thrown, true, "OCTREEFILE chunk views [missing file]");
+		std::cout << success << "OCTREEFILE chunk views" << std::endl;
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -31,7 +31,8 @@ enum class Command
 	INVALID,
 	HELP,
 	INFO,
-	GENERATE
+	GENERATE,
+	APPEND
 };
 
 // invalid
@@ -76,6 +77,7 @@ enum class GenerateInputType
 	RANDOM,
 	OCTREE,
 	HDF5,
+	RAW,
 };
 
 struct GenerateRandomInputArgs
@@ -104,10 +106,33 @@ struct GenerateHDF5InputArgs
 	std::string temperaturePath;
 };
 
+struct GenerateRawInputArgs
+{
+	std::string rawFile;
+	bool radius = false;
+	bool lum = false;
+	bool rgbLum = false;
+	bool density = false;
+	bool temperature = false;
+};
+
 struct GenerateOutputOptions
 {
 	bool normalizeNodes = true;
+	bool mortonConstruction = false;
+	bool exactLODSize = false;
+	bool medianSplit = false;
 	unsigned int maxParticlesPerNode = 16000;
+	size_t maxChunkBytes = 0; // 0 to use maxParticlesPerNode
+	size_t chunkAlignment = 1;
+	bool compressChunks = false;
+	bool quantizePositions = false;
+	bool nodeTable = false;
+	bool breadthFirstChunks = false;
+	unsigned int threadsNumber = 0;
+	unsigned long long seed = 0;
+	size_t memoryBudget = 0; // in MiB, 0 to construct in memory
+	std::string tmpDir = ".";
 };
 
 struct GenerateArguments
@@ -120,6 +145,7 @@ struct GenerateArguments
 	GenerateRandomInputArgs randomInputArgs;
 	GenerateOctreeInputArgs octreeInputArgs;
 	GenerateHDF5InputArgs hdf5InputArgs;
+	GenerateRawInputArgs rawInputArgs;
 
 	GenerateOutputOptions outputOptions;
 	std::string output;
@@ -127,6 +153,29 @@ struct GenerateArguments
 
 // end generate
 
+// append
+enum class AppendSubCommand
+{
+	INVALID,
+	HELP,
+	APPEND,
+};
+
+struct AppendArguments
+{
+	AppendSubCommand subcommand;
+	std::string errorMessage;
+
+	unsigned int maxParticlesPerNode = 16000;
+	size_t maxChunkBytes = 0; // 0 to use maxParticlesPerNode
+	unsigned long long seed = 0;
+	bool exactLODSize = false;
+
+	std::string octreeFile;
+	std::string rawFile;
+};
+// end append
+
 struct Arguments
 {
 	const Command command = Command::INVALID;
@@ -158,6 +207,9 @@ struct Arguments
 			case Command::GENERATE:
 				subargs = new GenerateArguments;
 				break;
+			case Command::APPEND:
+				subargs = new AppendArguments;
+				break;
 			default:
 				break;
 		}
@@ -180,6 +232,9 @@ struct Arguments
 			case Command::GENERATE:
 				delete static_cast<GenerateArguments*>(subargs);
 				break;
+			case Command::APPEND:
+				delete static_cast<AppendArguments*>(subargs);
+				break;
 			default:
 				break;
 		}
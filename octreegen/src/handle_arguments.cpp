@@ -18,6 +18,7 @@
 
 #include "handle_arguments.hpp"
 
+#include <cstdlib>
 #include <iostream>
 
 #include "utils.hpp"
@@ -83,12 +84,13 @@ arg::Arguments handle_generate_arguments(std::vector<std::string> const& argumen
 					subargs.errorMessage = "No input specified.";
 					return result;
 				}
-				if(arg == "--input-random" || arg == "--input-octree" || arg == "--input-hdf5")
+				if(arg == "--input-random" || arg == "--input-octree" || arg == "--input-hdf5" || arg == "--input-raw")
 				{
 					state = ParsingState::INPUT;
 					subargs.inputType = arg == "--input-random" ? arg::GenerateInputType::RANDOM :
 						(arg == "--input-octree" ? arg::GenerateInputType::OCTREE :
-						 arg::GenerateInputType::HDF5);
+						 (arg == "--input-hdf5" ? arg::GenerateInputType::HDF5 :
+						  arg::GenerateInputType::RAW));
 					break;
 				}
 				inputOptionsStr.push_back(arg);
@@ -308,7 +310,57 @@ arg::Arguments handle_generate_arguments(std::vector<std::string> const& argumen
 			return result;
 		}
 	}
+	else if(subargs.inputType == arg::GenerateInputType::RAW)
+	{
+		if(inputArgsStr.empty())
+		{
+			subargs.subcommand = arg::GenerateSubCommand::INVALID;
+			subargs.errorMessage = "Missing input argument (RAW-FILE).";
+			return result;
+		}
+		subargs.rawInputArgs.rawFile = inputArgsStr[0];
+		for(unsigned int i(1); i < inputArgsStr.size(); ++i)
+		{
+			auto s = inputArgsStr[i];
+			if(s == "--radius")
+			{
+				subargs.rawInputArgs.radius = true;
+				continue;
+			}
+			if(s == "--lum")
+			{
+				subargs.rawInputArgs.lum = true;
+				continue;
+			}
+			if(s == "--rgb-lum")
+			{
+				subargs.rawInputArgs.rgbLum = true;
+				continue;
+			}
+			if(s == "--density")
+			{
+				subargs.rawInputArgs.density = true;
+				continue;
+			}
+			if(s == "--temperature")
+			{
+				subargs.rawInputArgs.temperature = true;
+				continue;
+			}
+			// else
+			subargs.subcommand = arg::GenerateSubCommand::INVALID;
+			subargs.errorMessage = "Unknown raw input specifier: '" + s + "'";
+			return result;
+		}
+		if(subargs.inputOptions.sampleRate < 1.f)
+		{
+			subargs.subcommand = arg::GenerateSubCommand::INVALID;
+			subargs.errorMessage = "--sample-rate isn't supported with --input-raw.";
+			return result;
+		}
+	}
 	// Output options
+	bool seenMaxParticlesPerNode(false);
 	for(auto const& outOpt : outputOptionsStr)
 	{
 		if(outOpt == "--disable-node-normalization")
@@ -316,6 +368,41 @@ arg::Arguments handle_generate_arguments(std::vector<std::string> const& argumen
 			subargs.outputOptions.normalizeNodes = false;
 			continue;
 		}
+		if(outOpt == "--morton-construction")
+		{
+			subargs.outputOptions.mortonConstruction = true;
+			continue;
+		}
+		if(outOpt == "--exact-lod-size")
+		{
+			subargs.outputOptions.exactLODSize = true;
+			continue;
+		}
+		if(outOpt == "--median-split")
+		{
+			subargs.outputOptions.medianSplit = true;
+			continue;
+		}
+		if(outOpt == "--compress-chunks")
+		{
+			subargs.outputOptions.compressChunks = true;
+			continue;
+		}
+		if(outOpt == "--quantize-positions")
+		{
+			subargs.outputOptions.quantizePositions = true;
+			continue;
+		}
+		if(outOpt == "--node-table")
+		{
+			subargs.outputOptions.nodeTable = true;
+			continue;
+		}
+		if(outOpt == "--breadth-first-chunks")
+		{
+			subargs.outputOptions.breadthFirstChunks = true;
+			continue;
+		}
 		auto s(split(outOpt, '='));
 		if(s.size() != 2)
 		{
@@ -323,7 +410,9 @@ arg::Arguments handle_generate_arguments(std::vector<std::string> const& argumen
 			subargs.errorMessage = "Unknown output option: '" + outOpt + "'";
 			return result;
 		}
-		if(s[0] != "--max-particles-per-node")
+		if(s[0] != "--max-particles-per-node" && s[0] != "--max-chunk-bytes"
+		   && s[0] != "--chunk-alignment" && s[0] != "--threads"
+		   && s[0] != "--seed" && s[0] != "--memory-budget" && s[0] != "--tmp-dir")
 		{
 			subargs.subcommand = arg::GenerateSubCommand::INVALID;
 			subargs.errorMessage = "Unknown output option: '" + outOpt + "'";
@@ -347,7 +436,162 @@ arg::Arguments handle_generate_arguments(std::vector<std::string> const& argumen
 				}
 			}
 			subargs.outputOptions.maxParticlesPerNode = atoi(s[1].c_str());
+			seenMaxParticlesPerNode = true;
+		}
+		if(s[0] == "--max-chunk-bytes")
+		{
+			if(s[1].empty())
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid max chunk bytes (empty).";
+				return result;
+			}
+			for(char const& c : s[1])
+			{
+				if(c < '0' || c > '9')
+				{
+					subargs.subcommand = arg::GenerateSubCommand::INVALID;
+					subargs.errorMessage = "Invalid max chunk bytes (not an integer number): '" + s[1] + "'";
+					return result;
+				}
+			}
+			subargs.outputOptions.maxChunkBytes = strtoull(s[1].c_str(), nullptr, 10);
+		}
+		if(s[0] == "--chunk-alignment")
+		{
+			if(s[1].empty())
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid chunk alignment (empty).";
+				return result;
+			}
+			for(char const& c : s[1])
+			{
+				if(c < '0' || c > '9')
+				{
+					subargs.subcommand = arg::GenerateSubCommand::INVALID;
+					subargs.errorMessage = "Invalid chunk alignment (not an integer number): '" + s[1] + "'";
+					return result;
+				}
+			}
+			subargs.outputOptions.chunkAlignment = strtoull(s[1].c_str(), nullptr, 10);
+			if(subargs.outputOptions.chunkAlignment == 0
+			   || (subargs.outputOptions.chunkAlignment & (subargs.outputOptions.chunkAlignment - 1)) != 0)
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid chunk alignment (not a power of two): '" + s[1] + "'";
+				return result;
+			}
+		}
+		if(s[0] == "--threads")
+		{
+			if(s[1].empty())
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid threads number (empty).";
+				return result;
+			}
+			for(char const& c : s[1])
+			{
+				if(c < '0' || c > '9')
+				{
+					subargs.subcommand = arg::GenerateSubCommand::INVALID;
+					subargs.errorMessage = "Invalid threads number (not an integer number): '" + s[1] + "'";
+					return result;
+				}
+			}
+			subargs.outputOptions.threadsNumber = atoi(s[1].c_str());
+		}
+		if(s[0] == "--seed")
+		{
+			if(s[1].empty())
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid seed (empty).";
+				return result;
+			}
+			for(char const& c : s[1])
+			{
+				if(c < '0' || c > '9')
+				{
+					subargs.subcommand = arg::GenerateSubCommand::INVALID;
+					subargs.errorMessage = "Invalid seed (not an integer number): '" + s[1] + "'";
+					return result;
+				}
+			}
+			subargs.outputOptions.seed = strtoull(s[1].c_str(), nullptr, 10);
+		}
+		if(s[0] == "--memory-budget")
+		{
+			if(s[1].empty())
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid memory budget (empty).";
+				return result;
+			}
+			for(char const& c : s[1])
+			{
+				if(c < '0' || c > '9')
+				{
+					subargs.subcommand = arg::GenerateSubCommand::INVALID;
+					subargs.errorMessage = "Invalid memory budget (not an integer number): '" + s[1] + "'";
+					return result;
+				}
+			}
+			subargs.outputOptions.memoryBudget = strtoull(s[1].c_str(), nullptr, 10);
 		}
+		if(s[0] == "--tmp-dir")
+		{
+			if(s[1].empty())
+			{
+				subargs.subcommand = arg::GenerateSubCommand::INVALID;
+				subargs.errorMessage = "Invalid temporary directory (empty).";
+				return result;
+			}
+			subargs.outputOptions.tmpDir = s[1];
+		}
+	}
+	if(subargs.outputOptions.memoryBudget > 0 && subargs.inputType != arg::GenerateInputType::HDF5)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "Out-of-core construction (--memory-budget) is only supported with --input-hdf5.";
+		return result;
+	}
+	if(subargs.inputType == arg::GenerateInputType::RAW && subargs.outputOptions.mortonConstruction)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "--morton-construction isn't supported with --input-raw.";
+		return result;
+	}
+	if(subargs.outputOptions.medianSplit && subargs.outputOptions.mortonConstruction)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "--morton-construction and --median-split can't be used together.";
+		return result;
+	}
+	if(subargs.outputOptions.maxChunkBytes > 0 && seenMaxParticlesPerNode)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "--max-particles-per-node and --max-chunk-bytes can't be used together.";
+		return result;
+	}
+	if(subargs.outputOptions.memoryBudget > 0 && subargs.outputOptions.mortonConstruction)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "--morton-construction and --memory-budget can't be used together.";
+		return result;
+	}
+	if(subargs.outputOptions.breadthFirstChunks && subargs.outputOptions.memoryBudget > 0)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "--breadth-first-chunks and --memory-budget can't be used together.";
+		return result;
+	}
+	if(subargs.outputOptions.quantizePositions && !subargs.outputOptions.normalizeNodes)
+	{
+		subargs.subcommand = arg::GenerateSubCommand::INVALID;
+		subargs.errorMessage = "--quantize-positions and --disable-node-normalization can't be used together.";
+		return result;
 	}
 	// Output
 	if(subargs.output.empty())
@@ -360,6 +604,89 @@ arg::Arguments handle_generate_arguments(std::vector<std::string> const& argumen
 	return result;
 }
 
+arg::Arguments handle_append_arguments(std::vector<std::string> const& arguments)
+{
+	arg::Arguments result(arg::Command::APPEND);
+	auto& subargs = *static_cast<arg::AppendArguments*>(result.subargs);
+
+	if(arguments.empty() || arguments[0] == "-h" || arguments[0] == "--help")
+	{
+		subargs.subcommand = arg::AppendSubCommand::HELP;
+		return result;
+	}
+	subargs.subcommand = arg::AppendSubCommand::APPEND;
+
+	std::vector<std::string> files;
+	bool seenMaxParticlesPerNode(false);
+	for(auto const& arg : arguments)
+	{
+		if(arg.compare(0, 2, "--") != 0)
+		{
+			files.push_back(arg);
+			continue;
+		}
+		if(arg == "--exact-lod-size")
+		{
+			subargs.exactLODSize = true;
+			continue;
+		}
+		auto s(split(arg, '='));
+		if(s.size() != 2
+		   || (s[0] != "--max-particles-per-node" && s[0] != "--max-chunk-bytes"
+		       && s[0] != "--seed"))
+		{
+			subargs.subcommand = arg::AppendSubCommand::INVALID;
+			subargs.errorMessage = "Unknown option: '" + arg + "'";
+			return result;
+		}
+		if(s[1].empty())
+		{
+			subargs.subcommand = arg::AppendSubCommand::INVALID;
+			subargs.errorMessage = "Invalid " + s[0] + " value (empty).";
+			return result;
+		}
+		for(char const& c : s[1])
+		{
+			if(c < '0' || c > '9')
+			{
+				subargs.subcommand = arg::AppendSubCommand::INVALID;
+				subargs.errorMessage = "Invalid " + s[0] + " value (not an integer number): '" + s[1] + "'";
+				return result;
+			}
+		}
+		if(s[0] == "--max-particles-per-node")
+		{
+			subargs.maxParticlesPerNode = atoi(s[1].c_str());
+			seenMaxParticlesPerNode = true;
+		}
+		else if(s[0] == "--max-chunk-bytes")
+		{
+			subargs.maxChunkBytes = strtoull(s[1].c_str(), nullptr, 10);
+		}
+		else
+		{
+			subargs.seed = strtoull(s[1].c_str(), nullptr, 10);
+		}
+	}
+
+	if(subargs.maxChunkBytes > 0 && seenMaxParticlesPerNode)
+	{
+		subargs.subcommand = arg::AppendSubCommand::INVALID;
+		subargs.errorMessage = "--max-particles-per-node and --max-chunk-bytes can't be used together.";
+		return result;
+	}
+	if(files.size() != 2)
+	{
+		subargs.subcommand = arg::AppendSubCommand::INVALID;
+		subargs.errorMessage = "Expected an octree file and a raw file, got " + std::to_string(files.size()) + " file(s).";
+		return result;
+	}
+	subargs.octreeFile = files[0];
+	subargs.rawFile = files[1];
+
+	return result;
+}
+
 arg::Arguments handle_arguments(int argc, char* argv[])
 {
 	if(argc <= 1)
@@ -390,6 +717,15 @@ arg::Arguments handle_arguments(int argc, char* argv[])
 		}
 		return handle_generate_arguments(remainingArgs);
 	}
+	if(command == "append")
+	{
+		std::vector<std::string> remainingArgs;
+		for(int i(0); i < argc - 2; ++i)
+		{
+			remainingArgs.push_back(argv[2 + i]);
+		}
+		return handle_append_arguments(remainingArgs);
+	}
 
 	arg::Arguments result(arg::Command::INVALID);
 	auto& args(*static_cast<arg::InvalidArguments*>(result.subargs));
@@ -17,6 +17,7 @@
 */
 
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <vector>
@@ -37,7 +38,9 @@ void executeHelp(std::string const& argv_0)
 	          << "\t\t" << argv_0 << " info ..." << std::endl
 	          << "\t\t\tPrints informations from an existing octree file." << std::endl
 	          << "\t\t" << argv_0 << " generate..." << std::endl
-	          << "\t\t\tGenerates an octree file given data from various sources." << std::endl << std::endl
+	          << "\t\t\tGenerates an octree file given data from various sources." << std::endl
+	          << "\t\t" << argv_0 << " append ..." << std::endl
+	          << "\t\t\tAdds particles to an existing octree file." << std::endl << std::endl
 	          << "\t\tAll commands have a [-h|-help] option to display their own help page." << std::endl;
 }
 
@@ -92,6 +95,18 @@ void executeInfo(arg::InfoArguments const& args, std::string const& argv_0)
 	{
 		flagsStr += "VERSIONED, ";
 	}
+	if((flags & Octree::Flags::COMPRESSED_CHUNKS) != Octree::Flags::NONE)
+	{
+		flagsStr += "COMPRESSED_CHUNKS, ";
+	}
+	if((flags & Octree::Flags::QUANTIZED_POSITIONS) != Octree::Flags::NONE)
+	{
+		flagsStr += "QUANTIZED_POSITIONS, ";
+	}
+	if((flags & Octree::Flags::NODE_TABLE) != Octree::Flags::NONE)
+	{
+		flagsStr += "NODE_TABLE, ";
+	}
 	if((flags & Octree::Flags::STORE_RADIUS) != Octree::Flags::NONE)
 	{
 		flagsStr += "STORE_RADIUS, ";
@@ -116,6 +131,7 @@ void executeInfo(arg::InfoArguments const& args, std::string const& argv_0)
 	flagsStr.resize(flagsStr.size() - 2);
 	std::cout << flagsStr << std::endl;
 	std::cout << '\t' << "Vertex dimension : " << octree.getDimPerVertex() << std::endl;
+	std::cout << '\t' << "Chunk alignment : " << octree.getChunkAlignment() << std::endl;
 
 	std::ifstream in;
 	in.open(args.input, std::fstream::in | std::fstream::binary);
@@ -172,11 +188,30 @@ void executeGenerateHelp(std::string const& argv_0)
         << "\t\t\t--lum-path=<LUM-DATASET-PATH> : total luminosity (1D dataset)" << std::endl
         << "\t\t\t--rgb-lum-path=<RGB-LUM-PATH> : luminosity per band (3D dataset)" << std::endl
         << "\t\t\t--density-path=<DENSITY-DATASET-PATH> : 1D dataset" << std::endl
-        << "\t\t\t--temperature-path=<TEMPERATURE-DATASET-PATH> : 1D dataset" << std::endl << std::endl
+        << "\t\t\t--temperature-path=<TEMPERATURE-DATASET-PATH> : 1D dataset" << std::endl
+	<< "\t\t--input-raw <RAW-FILE> [ADDITIONAL-DIMENSIONS] : specifies a raw binary file of 32 bits floats as input, holding for each particle its coordinates followed by its additional dimensions (in the order below). The file is mapped in memory and the octree is constructed in place, without copying it (the file isn't modified). --sample-rate and --morton-construction aren't supported. Additional dimensions can be specified as ADDITIONAL-DIMENSIONS :" << std::endl
+		<< "\t\t\t--radius" << std::endl
+		<< "\t\t\t--lum" << std::endl
+		<< "\t\t\t--rgb-lum" << std::endl
+		<< "\t\t\t--density" << std::endl
+		<< "\t\t\t--temperature" << std::endl << std::endl
 
 	<< "\tOUTPUT-OPTIONS" << std::endl
     << "\t\t--disable-node-normalization : disables particles having coordinates in [0;1] relative to their node, which is on by default" << std::endl
-	<< "\t\t--max-particles-per-node=<MAX_PART_PER_NODE> : defines a particle number above which a node is split in 8 sub-nodes (and below which it becomes a leaf). MAX_PART_PER_NODE is 16000 by default." << std::endl << std::endl;
+    << "\t\t--morton-construction : constructs the octree by sorting the particles along a Morton (Z-order) curve, which scales better with the number of threads but needs more memory. Nodes are then split on a regular grid instead of at the middle of their own bounding box." << std::endl
+	<< "\t\t--exact-lod-size : makes every non-leaf node hold exactly MAX_PART_PER_NODE particles, uniformly sampled among the particles of its subtree. By default, each particle is kept with probability MAX_PART_PER_NODE / (number of particles of the subtree), so non-leaf nodes usually hold fewer particles." << std::endl
+	<< "\t\t--median-split : splits each node at the median position of its particles along each axis instead of at the middle of its bounding box. On clustered data, this gives a shallower tree with fuller leaves. Not supported with --morton-construction. With --memory-budget, only applies to the nodes constructed in memory." << std::endl
+	<< "\t\t--max-particles-per-node=<MAX_PART_PER_NODE> : defines a particle number above which a node is split in 8 sub-nodes (and below which it becomes a leaf). MAX_PART_PER_NODE is 16000 by default." << std::endl
+	<< "\t\t--max-chunk-bytes=<MAX_CHUNK_BYTES> : derives MAX_PART_PER_NODE from the size of the particles so that no node data chunk exceeds MAX_CHUNK_BYTES bytes in the output file, except for leaves holding more than MAX_PART_PER_NODE particles at identical positions, which can't be split (ex: --max-chunk-bytes=262144 for 256 KiB chunks matching the I/O block size). Can't be used with --max-particles-per-node." << std::endl
+	<< "\t\t--chunk-alignment=<ALIGNMENT> : pads the node data chunks so that their particles start at a multiple of ALIGNMENT bytes in the output file (ex: --chunk-alignment=4096 to read them with direct I/O). ALIGNMENT must be a power of two, and is 1 (no padding) by default. Aligned files use format version 2.1." << std::endl
+	<< "\t\t--compress-chunks : losslessly compresses the node data chunks (transposing the bits of the particles components and run-length encoding them), which mostly shrinks files whose nodes aren't normalized. Compressed files use format version 2.2." << std::endl
+	<< "\t\t--quantize-positions : stores the particles positions as 16-bit fixed-point numbers relative to their node (lossy, positions are rounded to 1/65535 of the biggest side of their node), which halves the space they take. Takes precedence over --compress-chunks and can't be used with --disable-node-normalization. Such files use format version 2.3." << std::endl
+	<< "\t\t--node-table : writes a table of the nodes at the end of the output file, from which readers can locate any node without parsing the tree structure first. Such files use format version 2.4." << std::endl
+	<< "\t\t--breadth-first-chunks : writes the node data chunks level by level from the root instead of subtree by subtree, so that the first levels of the octree can be loaded with a single sequential read. Can't be used with --memory-budget." << std::endl
+	<< "\t\t--memory-budget=<MEMORY-BUDGET> : constructs the octree out-of-core, using about MEMORY-BUDGET MiB of memory for the particles (input files are still read one by one). Particles are spilled to temporary files, which need about twice the size of the particles, and nodes are split by streaming them until their subtrees fit in memory. Only supported with --input-hdf5." << std::endl
+	<< "\t\t--tmp-dir=<TMP-DIR> : directory where temporary files of out-of-core construction are written. TMP-DIR is the current directory by default." << std::endl
+	<< "\t\t--threads=<THREADS-NUMBER> : number of threads used to construct the octree. Uses as many threads as the hardware supports by default (or if THREADS-NUMBER is 0)." << std::endl
+	<< "\t\t--seed=<SEED> : seed of the random sampling of the particles stored in non-leaf nodes. The same input, options and seed always give the same octree, whatever the number of threads. SEED is 0 by default." << std::endl << std::endl;
 
 	std::cout << "Examples: " << std::endl
 	          << "\t"
@@ -249,6 +284,15 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 			std::cout << "\tDensity path :\t\t\t'" << args.hdf5InputArgs.densityPath << "'" << std::endl;
 			std::cout << "\tTemperature path :\t\t'" << args.hdf5InputArgs.temperaturePath << "'" << std::endl;
 			break;
+		case arg::GenerateInputType::RAW:
+			std::cout << "Input Type :\t\t\t\tRAW" << std::endl;
+			std::cout << "\tFile :\t\t\t\t" << args.rawInputArgs.rawFile << std::endl;
+			std::cout << "\tRadius :\t\t\t" << (args.rawInputArgs.radius ? "on" : "off") << std::endl;
+			std::cout << "\tLum :\t\t\t\t" << (args.rawInputArgs.lum ? "on" : "off") << std::endl;
+			std::cout << "\tRGB lum :\t\t\t" << (args.rawInputArgs.rgbLum ? "on" : "off") << std::endl;
+			std::cout << "\tDensity :\t\t\t" << (args.rawInputArgs.density ? "on" : "off") << std::endl;
+			std::cout << "\tTemperature :\t\t\t" << (args.rawInputArgs.temperature ? "on" : "off") << std::endl;
+			break;
 		default:
 			std::cout << "Input Type : INVALID" << std::endl;
 			break;
@@ -257,13 +301,32 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 
 	std::cout << "Output options :" << std::endl;
 	std::cout << "\tNode normalization :\t\t" << (args.outputOptions.normalizeNodes ? "on" : "off") << std::endl;
+	std::cout << "\tMorton construction :\t\t" << (args.outputOptions.mortonConstruction ? "on" : "off") << std::endl;
+	std::cout << "\tExact LOD size :\t\t" << (args.outputOptions.exactLODSize ? "on" : "off") << std::endl;
+	std::cout << "\tMedian split :\t\t\t" << (args.outputOptions.medianSplit ? "on" : "off") << std::endl;
 	std::cout << "\tMax particles per node :\t" << args.outputOptions.maxParticlesPerNode << std::endl;
+	std::cout << "\tMax chunk bytes :\t\t" << (args.outputOptions.maxChunkBytes > 0 ? std::to_string(args.outputOptions.maxChunkBytes) : "none") << std::endl;
+	std::cout << "\tChunk alignment :\t\t" << args.outputOptions.chunkAlignment << std::endl;
+	std::cout << "\tChunk compression :\t\t" << (args.outputOptions.compressChunks ? "on" : "off") << std::endl;
+	std::cout << "\tPositions quantization :\t" << (args.outputOptions.quantizePositions ? "on" : "off") << std::endl;
+	std::cout << "\tNode table :\t\t\t" << (args.outputOptions.nodeTable ? "on" : "off") << std::endl;
+	std::cout << "\tBreadth-first chunks :\t\t" << (args.outputOptions.breadthFirstChunks ? "on" : "off") << std::endl;
+	std::cout << "\tThreads number :\t\t" << args.outputOptions.threadsNumber << std::endl;
+	std::cout << "\tSeed :\t\t\t\t" << args.outputOptions.seed << std::endl;
+	std::cout << "\tMemory budget (MiB) :\t\t" << (args.outputOptions.memoryBudget > 0 ? std::to_string(args.outputOptions.memoryBudget) : "none (in memory)") << std::endl;
+	std::cout << "\tTemporary directory :\t\t" << args.outputOptions.tmpDir << std::endl;
 	std::cout << std::endl;
 
 	std::cout << "Output :\t\t\t\t" << args.output << std::endl << std::endl;
 
 
 	std::vector<float> v; // contains octree construction data
+	// gives construction data by batches for out-of-core construction
+	std::function<void(Octree::VerticesConsumer const&)> produceVertices;
+	// construction data mapped from a raw file, used instead of v if not
+	// nullptr
+	float* rawData(nullptr);
+	size_t rawSize(0);
 	Octree::Flags flags(Octree::Flags::NONE);
 	// CONSTRUCT INPUT
 	switch(args.inputType)
@@ -308,11 +371,11 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 				readOctreeStructureOnly(f, oc);
 				if(flags == Octree::Flags::NONE)
 				{
-					flags = oc.getFlags() & ~Octree::Flags::VERSIONED & ~Octree::Flags::NORMALIZED_NODES;
+					flags = oc.getFlags() & ~Octree::Flags::VERSIONED & ~Octree::Flags::NORMALIZED_NODES & ~Octree::Flags::COMPRESSED_CHUNKS & ~Octree::Flags::QUANTIZED_POSITIONS & ~Octree::Flags::NODE_TABLE;
 				}
-				else if((oc.getFlags() & ~Octree::Flags::VERSIONED & ~Octree::Flags::NORMALIZED_NODES) != flags)
+				else if((oc.getFlags() & ~Octree::Flags::VERSIONED & ~Octree::Flags::NORMALIZED_NODES & ~Octree::Flags::COMPRESSED_CHUNKS & ~Octree::Flags::QUANTIZED_POSITIONS & ~Octree::Flags::NODE_TABLE) != flags)
 				{
-					std::cerr << "ERROR: Octree files don't share the same flags (VERSIONED and NORMALIZED_NODES don't count)." << std::endl;
+					std::cerr << "ERROR: Octree files don't share the same flags (VERSIONED, NORMALIZED_NODES, COMPRESSED_CHUNKS, QUANTIZED_POSITIONS and NODE_TABLE don't count)." << std::endl;
 					return;
 				}
 				readOctreeContentOnly(f, oc);
@@ -361,7 +424,6 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 				std::cout << "Total number of vertices to read : " << verticesNumber << std::endl;
 
 				unsigned int stride(3);
-				size_t fileOffset(0), offset(0);
 				if(!args.hdf5InputArgs.radiusPath.empty())
 				{
 					flags |= Octree::Flags::STORE_RADIUS;
@@ -387,86 +449,99 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 					flags |= Octree::Flags::STORE_TEMPERATURE;
 					stride++;
 				}
-				for(auto file : args.hdf5InputArgs.hdf5Files)
+				// reads the files and gives their vertices file by file
+				auto readFiles = [&args, stride](Octree::VerticesConsumer const& addVertices)
 				{
-					std::vector<float> data;
-					std::cout << file << std::endl;
+					size_t fileOffset(0), offset(0);
+					for(auto file : args.hdf5InputArgs.hdf5Files)
+					{
+						std::vector<float> data;
+						std::cout << file << std::endl;
 
-					offset = 0;
-					size_t fileOffset_back(fileOffset);
+						offset = 0;
+						size_t fileOffset_back(fileOffset);
 
-					Octree::showProgress(0.f);
-					fileOffset += stride
-								  * readHDF5Dataset(file, args.hdf5InputArgs.coordPath.c_str(), data,
-													fileOffset_back + offset, stride);
-					offset += 3;
-					Octree::showProgress(offset / (float) stride);
-					if(!args.hdf5InputArgs.radiusPath.empty())
-					{
-						readHDF5Dataset(file, args.hdf5InputArgs.radiusPath.c_str(), data,
-										fileOffset_back + offset, stride);
-						offset++;
-						Octree::showProgress(offset / (float) stride);
-					}
-					if(!args.hdf5InputArgs.lumPath.empty())
-					{
-						readHDF5Dataset(file, args.hdf5InputArgs.lumPath.c_str(), data,
-										fileOffset_back + offset, stride);
-						offset++;
-						Octree::showProgress(offset / (float) stride);
-					}
-					if(!args.hdf5InputArgs.rgbLumPath.empty())
-					{
-						readHDF5Dataset(file, args.hdf5InputArgs.rgbLumPath.c_str(), data,
-										fileOffset_back + offset, stride);
+						Octree::showProgress(0.f);
+						fileOffset += stride
+									  * readHDF5Dataset(file, args.hdf5InputArgs.coordPath.c_str(), data,
+														fileOffset_back + offset, stride);
 						offset += 3;
 						Octree::showProgress(offset / (float) stride);
-					}
-					if(!args.hdf5InputArgs.densityPath.empty())
-					{
-						readHDF5Dataset(file, args.hdf5InputArgs.densityPath.c_str(), data,
-										fileOffset_back + offset, stride);
-						offset++;
-						Octree::showProgress(offset / (float) stride);
-					}
-					if(!args.hdf5InputArgs.temperaturePath.empty())
-					{
-						readHDF5Dataset(file, args.hdf5InputArgs.temperaturePath.c_str(), data,
-										fileOffset_back + offset, stride);
-						offset++;
-						Octree::showProgress(offset / (float) stride);
-					}
-					v.reserve(v.size() + data.size() * args.inputOptions.sampleRate);
-					size_t addedVertices(data.size() / stride);
-					if(args.inputOptions.sampleRate >= 1.f)
-					{
-						v.insert(v.end(), data.begin(), data.end());
-					}
-					else
-					{
-						addedVertices = 0;
-						std::cout << "Subsampling data :" << std::endl;
-						Octree::showProgress(0.f);
-						for(size_t i(0); i < data.size(); i += stride)
+						if(!args.hdf5InputArgs.radiusPath.empty())
+						{
+							readHDF5Dataset(file, args.hdf5InputArgs.radiusPath.c_str(), data,
+											fileOffset_back + offset, stride);
+							offset++;
+							Octree::showProgress(offset / (float) stride);
+						}
+						if(!args.hdf5InputArgs.lumPath.empty())
+						{
+							readHDF5Dataset(file, args.hdf5InputArgs.lumPath.c_str(), data,
+											fileOffset_back + offset, stride);
+							offset++;
+							Octree::showProgress(offset / (float) stride);
+						}
+						if(!args.hdf5InputArgs.rgbLumPath.empty())
 						{
-							if((static_cast<float>(rand()) / static_cast<float>(RAND_MAX))
-								  < args.inputOptions.sampleRate)
+							readHDF5Dataset(file, args.hdf5InputArgs.rgbLumPath.c_str(), data,
+											fileOffset_back + offset, stride);
+							offset += 3;
+							Octree::showProgress(offset / (float) stride);
+						}
+						if(!args.hdf5InputArgs.densityPath.empty())
+						{
+							readHDF5Dataset(file, args.hdf5InputArgs.densityPath.c_str(), data,
+											fileOffset_back + offset, stride);
+							offset++;
+							Octree::showProgress(offset / (float) stride);
+						}
+						if(!args.hdf5InputArgs.temperaturePath.empty())
+						{
+							readHDF5Dataset(file, args.hdf5InputArgs.temperaturePath.c_str(), data,
+											fileOffset_back + offset, stride);
+							offset++;
+							Octree::showProgress(offset / (float) stride);
+						}
+						size_t addedVertices(data.size() / stride);
+						if(args.inputOptions.sampleRate >= 1.f)
+						{
+							addVertices(data);
+						}
+						else
+						{
+							addedVertices = 0;
+							std::vector<float> sampled;
+							std::cout << "Subsampling data :" << std::endl;
+							Octree::showProgress(0.f);
+							for(size_t i(0); i < data.size(); i += stride)
 							{
-								++addedVertices;
-								for(size_t j(0); j < stride; ++j)
+								if((static_cast<float>(rand()) / static_cast<float>(RAND_MAX))
+									  < args.inputOptions.sampleRate)
 								{
-									v.push_back(data[i+j]);
+									++addedVertices;
+									for(size_t j(0); j < stride; ++j)
+									{
+										sampled.push_back(data[i+j]);
+									}
+								}
+								if(i % 10000000 == 0)
+								{
+									Octree::showProgress(static_cast<float>(i) / data.size());
 								}
 							}
-							if(i % 10000000 == 0)
-							{
-								Octree::showProgress(static_cast<float>(i) / data.size());
-							}
+							Octree::showProgress(1.f);
+							addVertices(sampled);
 						}
-						Octree::showProgress(1.f);
+						std::cout << "Added " << addedVertices << " vertices." << std::endl;
 					}
-					std::cout << "Added " << addedVertices << " vertices." << std::endl;
+				};
+				if(args.outputOptions.memoryBudget > 0)
+				{
+					// the files will be read during the octree construction
+					produceVertices = readFiles;
+					break;
 				}
+				readFiles([&v](std::vector<float> const& vertices) { v.insert(v.end(), vertices.begin(), vertices.end()); });
 
 				std::cout << "Loaded from file(s) : " << v.size() / stride << " points"
 						  << std::endl;
@@ -478,6 +553,53 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 				return;
 			}
 			break;
+		case arg::GenerateInputType::RAW:
+			{
+				unsigned int dimPerVertex(3);
+				if(args.rawInputArgs.radius)
+				{
+					flags |= Octree::Flags::STORE_RADIUS;
+					dimPerVertex += 1;
+				}
+				if(args.rawInputArgs.lum)
+				{
+					flags |= Octree::Flags::STORE_LUMINOSITY;
+					dimPerVertex += 1;
+				}
+				if(args.rawInputArgs.rgbLum)
+				{
+					flags |= Octree::Flags::STORE_COLOR;
+					dimPerVertex += 3;
+				}
+				if(args.rawInputArgs.density)
+				{
+					flags |= Octree::Flags::STORE_DENSITY;
+					dimPerVertex += 1;
+				}
+				if(args.rawInputArgs.temperature)
+				{
+					flags |= Octree::Flags::STORE_TEMPERATURE;
+					dimPerVertex += 1;
+				}
+				try
+				{
+					rawData = mapRawFile(args.rawInputArgs.rawFile, rawSize);
+				}
+				catch(std::string s)
+				{
+					std::cerr << "Error while reading raw file :" << std::endl;
+					std::cerr << s << std::endl;
+					return;
+				}
+				if(rawSize % dimPerVertex != 0)
+				{
+					std::cerr << "ERROR: Raw file size isn't a multiple of the size of a particle (" << dimPerVertex << " floats)." << std::endl;
+					unmapRawFile(rawData, rawSize);
+					return;
+				}
+				std::cout << "Mapped from file : " << rawSize / dimPerVertex << " points" << std::endl;
+			}
+			break;
 		default:
 			std::cerr << "ERROR: Invalid generate command: unknown input type." << std::endl;
 			executeGenerateHelp(argv_0);
@@ -488,23 +610,210 @@ void executeGenerate(arg::GenerateArguments const& args, std::string const& argv
 	{
 		flags |= Octree::Flags::NORMALIZED_NODES;
 	}
+	if(args.outputOptions.compressChunks)
+	{
+		flags |= Octree::Flags::COMPRESSED_CHUNKS;
+	}
+	if(args.outputOptions.quantizePositions)
+	{
+		flags |= Octree::Flags::QUANTIZED_POSITIONS;
+	}
+	if(args.outputOptions.nodeTable)
+	{
+		flags |= Octree::Flags::NODE_TABLE;
+	}
 
 	Octree octree;
 
 	octree.setFlags(flags);
+	octree.setThreadsNumber(args.outputOptions.threadsNumber);
+	octree.setSeed(args.outputOptions.seed);
+	octree.setProgressCallback(Octree::showProgress);
+	if(args.outputOptions.exactLODSize)
+	{
+		octree.setSamplingMode(Octree::SamplingMode::EXACT);
+	}
+	if(args.outputOptions.medianSplit)
+	{
+		octree.setSplitStrategy(Octree::SplitStrategy::MEDIAN);
+	}
+	if(args.outputOptions.breadthFirstChunks)
+	{
+		octree.setChunkOrder(Octree::ChunkOrder::BREADTH_FIRST);
+	}
+	octree.setChunkAlignment(args.outputOptions.chunkAlignment);
+	unsigned int maxPart(args.outputOptions.maxParticlesPerNode);
+	if(args.outputOptions.maxChunkBytes > 0)
+	{
+		maxPart = octree.getMaxLeafSizeForChunkSize(args.outputOptions.maxChunkBytes);
+		if(maxPart == 0)
+		{
+			std::cerr << "ERROR: Max chunk bytes is too small to hold a single particle." << std::endl;
+			if(rawData != nullptr)
+			{
+				unmapRawFile(rawData, rawSize);
+			}
+			return;
+		}
+		std::cout << "Max particles per node :\t" << maxPart << std::endl;
+	}
+	if(args.outputOptions.memoryBudget > 0)
+	{
+		std::ofstream f(args.output, std::ios_base::out | std::ios_base::binary);
+		std::cout << "Constructing octree out-of-core and writing it to output file '" << args.output << "' :" << std::endl;
+		try
+		{
+			octree.initOutOfCore(f, produceVertices, maxPart,
+			                     args.outputOptions.memoryBudget * 1024 * 1024, args.outputOptions.tmpDir);
+		}
+		catch(std::string s)
+		{
+			std::cerr << "Error while constructing the octree :" << std::endl;
+			std::cerr << s << std::endl;
+			return;
+		}
+		f.close();
+		std::cout << "Conversion successfull !" << std::endl;
+		return;
+	}
+
 	std::cout << "Constructing octree :" << std::endl;
 	Octree::showProgress(0.f);
-	octree.init(v, args.outputOptions.maxParticlesPerNode);
+	if(rawData != nullptr)
+	{
+		octree.init(rawData, rawSize, maxPart);
+	}
+	else if(args.outputOptions.mortonConstruction)
+	{
+		octree.initMorton(v, maxPart);
+	}
+	else
+	{
+		octree.init(v, maxPart);
+	}
 
-	std::ofstream f(args.output, std::ios_base::out | std::ios_base::binary);
 	std::cout << "Writing octree to output file '" << args.output << "' :" << std::endl;
 	Octree::showProgress(0.f);
-	write(f, octree);
+	try
+	{
+		write(args.output, octree);
+	}
+	catch(std::string s)
+	{
+		std::cerr << "Error while writing the octree :" << std::endl;
+		std::cerr << s << std::endl;
+		if(rawData != nullptr)
+		{
+			unmapRawFile(rawData, rawSize);
+		}
+		return;
+	}
 	Octree::showProgress(1.f);
-	f.close();
+	if(rawData != nullptr)
+	{
+		unmapRawFile(rawData, rawSize);
+	}
 	std::cout << "Conversion successfull !" << std::endl;
 }
 
+void executeAppendHelp(std::string const& argv_0)
+{
+	std::cout << "Usage: " << std::endl
+	          << "\t" << argv_0 << " append [-h|--help]" << std::endl
+			  << "\t\t Prints this help message." << std::endl
+	          << "\t" << argv_0 << " append [OPTIONS] <OCTREE-FILE> <RAW-FILE>" << std::endl
+			  << "\t\tAdds the particles of RAW-FILE to OCTREE-FILE, without generating it again. RAW-FILE holds 32 bits floats, with the same components per particle as OCTREE-FILE (see --input-raw of generate). Particles are inserted within the existing nodes, only the nodes they are inserted in are written again (at the end of the file, which grows a bit more than the particles added)." << std::endl << std::endl
+			  << "\tOPTIONS:" << std::endl
+			  << "\t\t--max-particles-per-node=<MAX_PART_PER_NODE> : should be the one OCTREE-FILE was generated with. MAX_PART_PER_NODE is 16000 by default." << std::endl
+			  << "\t\t--max-chunk-bytes=<MAX_CHUNK_BYTES> : to use instead of --max-particles-per-node if OCTREE-FILE was generated with it." << std::endl
+			  << "\t\t--seed=<SEED> : seed of the random sampling of the particles stored in non-leaf nodes. SEED is 0 by default." << std::endl
+			  << "\t\t--exact-lod-size : new nodes store exactly MAX_PART_PER_NODE particles (see generate)." << std::endl;
+}
+
+void executeAppend(arg::AppendArguments const& args, std::string const& argv_0)
+{
+	switch(args.subcommand)
+	{
+		case arg::AppendSubCommand::INVALID:
+		std::cerr << "ERROR: Invalid append command: " << args.errorMessage << std::endl;
+		executeAppendHelp(argv_0);
+		return;
+		case arg::AppendSubCommand::HELP:
+		executeAppendHelp(argv_0);
+		return;
+		case arg::AppendSubCommand::APPEND:
+		break;
+	}
+
+	std::fstream f(args.octreeFile, std::fstream::in | std::fstream::out | std::fstream::binary);
+	if(!f.is_open())
+	{
+		std::cerr << "ERROR: Cannot open octree file '" << args.octreeFile << "'." << std::endl;
+		return;
+	}
+	Octree octree;
+	octree.setSeed(args.seed);
+	if(args.exactLODSize)
+	{
+		octree.setSamplingMode(Octree::SamplingMode::EXACT);
+	}
+	std::cout << "Loading octree structure..." << std::endl;
+	try
+	{
+		octree.init(f);
+	}
+	catch(std::string s)
+	{
+		std::cerr << "Error while reading octree file :" << std::endl;
+		std::cerr << s << std::endl;
+		return;
+	}
+
+	float* rawData(nullptr);
+	size_t rawSize(0);
+	try
+	{
+		rawData = mapRawFile(args.rawFile, rawSize);
+	}
+	catch(std::string s)
+	{
+		std::cerr << "Error while reading raw file :" << std::endl;
+		std::cerr << s << std::endl;
+		return;
+	}
+	if(rawSize % octree.getDimPerVertex() != 0)
+	{
+		std::cerr << "ERROR: Raw file size isn't a multiple of the size of a particle (" << octree.getDimPerVertex() << " floats)." << std::endl;
+		unmapRawFile(rawData, rawSize);
+		return;
+	}
+
+	std::cout << "Appending " << rawSize / octree.getDimPerVertex() << " points to '" << args.octreeFile << "'..." << std::endl;
+	try
+	{
+		unsigned int maxPart(args.maxParticlesPerNode);
+		if(args.maxChunkBytes > 0)
+		{
+			maxPart = octree.getMaxLeafSizeForChunkSize(args.maxChunkBytes);
+			if(maxPart == 0)
+			{
+				throw(std::string("Max chunk bytes is too small to hold a single particle."));
+			}
+		}
+		octree.append(f, rawData, rawSize, maxPart);
+	}
+	catch(std::string s)
+	{
+		std::cerr << "Error while appending to the octree :" << std::endl;
+		std::cerr << s << std::endl;
+		unmapRawFile(rawData, rawSize);
+		return;
+	}
+	unmapRawFile(rawData, rawSize);
+	f.close();
+	std::cout << "Append successfull !" << std::endl;
+}
+
 int main(int argc, char* argv[])
 {
 	auto arguments(handle_arguments(argc, argv));
@@ -522,6 +831,9 @@ int main(int argc, char* argv[])
 		case arg::Command::GENERATE:
 			executeGenerate(*static_cast<arg::GenerateArguments*>(arguments.subargs), argv[0]);
 			break;
+		case arg::Command::APPEND:
+			executeAppend(*static_cast<arg::AppendArguments*>(arguments.subargs), argv[0]);
+			break;
 	}
 	return EXIT_SUCCESS;
 }
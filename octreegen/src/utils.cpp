@@ -22,6 +22,9 @@
 #include <Windows.h>
 void sleepOneSec() { Sleep(1000);}
 #else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 void sleepOneSec() { usleep(999999);}
 #endif
@@ -442,6 +445,60 @@ std::vector<float> readHDF5(std::string const& filePath,
 	return result;
 }
 
+// Maps a raw file of floats in memory. The mapping is private : it can be
+// written to without modifying the file (modified pages are copied on write).
+// size is set to the number of floats.
+float* mapRawFile(std::string const& filePath, size_t& size)
+{
+#ifdef _WIN32
+	(void) size;
+	throw(filePath + " : raw input isn't supported on Windows.");
+#else
+	int fd(open(filePath.c_str(), O_RDONLY));
+	if(fd < 0)
+	{
+		throw("Cannot open " + filePath);
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+	{
+		close(fd);
+		throw("Cannot get size of " + filePath);
+	}
+	// trailing bytes would be silently dropped
+	if(st.st_size % sizeof(float) != 0)
+	{
+		close(fd);
+		throw(filePath + " size isn't a multiple of the size of a float ("
+		      + std::to_string(sizeof(float)) + " bytes).");
+	}
+	size = st.st_size / sizeof(float);
+	if(size == 0)
+	{
+		close(fd);
+		throw(filePath + " is empty.");
+	}
+	void* data(mmap(nullptr, size * sizeof(float), PROT_READ | PROT_WRITE,
+	                MAP_PRIVATE, fd, 0));
+	close(fd);
+	if(data == MAP_FAILED)
+	{
+		throw("Cannot map " + filePath + " in memory.");
+	}
+	return static_cast<float*>(data);
+#endif
+}
+
+void unmapRawFile(float* data, size_t size)
+{
+#ifdef _WIN32
+	(void) data;
+	(void) size;
+#else
+	munmap(data, size * sizeof(float));
+#endif
+}
+
 void initOctree(Octree* octree, std::istream* file)
 {
 	octree->init(*file);